@@ -0,0 +1,37 @@
+import cffi
+var lib = cffi.import_lib("./build/tests/test_cffi.csx")
+var add = lib.import_func_s("add_quiet", cffi.types.sint, {cffi.types.sint, cffi.types.sint})
+var scale = lib.import_func_s("scale_quiet", cffi.types.double, {cffi.types.double, cffi.types.float})
+var times = 1000000
+function report(name, start)
+    var elapsed = runtime.time() - start
+    system.out.println(name + ": " + to_integer(times / elapsed * 1000) + " calls/s")
+end
+# Bench integer arguments
+var start = runtime.time()
+for i = 0, i < times, ++i
+    add(i, 1)
+end
+report("import_func_s(sint, sint)", start)
+# Bench floating point arguments
+start = runtime.time()
+for i = 0, i < times, ++i
+    scale(i * 0.5, 2.0)
+end
+report("import_func_s(double, float)", start)
+# Bench batched calls
+var rows = new array
+foreach i in range(times) do rows.push_back({i, 1})
+start = runtime.time()
+cffi.lib.call_batch(add, rows)
+report("lib.call_batch(sint, sint)", start)
+# Bench with profiling enabled
+cffi.enable_stats(true)
+start = runtime.time()
+for i = 0, i < times, ++i
+    add(i, 1)
+end
+report("import_func_s(sint, sint) with stats", start)
+cffi.enable_stats(false)
+var stats = cffi.stats()["./build/tests/test_cffi.csx:add_quiet"]
+system.out.println("add_quiet: marshal " + stats["marshal_ns"] + "ns, call " + stats["call_ns"] + "ns, unmarshal " + stats["unmarshal_ns"] + "ns")
@@ -1,10 +1,2929 @@
 #include <covscript/cni.hpp>
 #include <covscript/dll.hpp>
 #include <cstdint>
+#include <cstring>
+#include <cctype>
 #include <bitset>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <fstream>
+#include <iterator>
+#include <cmath>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BITWISE_X86_DISPATCH
+#include <immintrin.h>
+#endif
 
 using bitset_t = std::bitset<std::numeric_limits<std::uint64_t>::digits>;
 
+// Word kernels for bitvec, AVX2 versions are selected at runtime
+
+namespace bitwise_kernels {
+	struct op_and {
+		static std::uint64_t apply(std::uint64_t a, std::uint64_t b) noexcept
+		{
+			return a & b;
+		}
+#ifdef BITWISE_X86_DISPATCH
+		__attribute__((target("avx2"))) static __m256i apply(__m256i a, __m256i b) noexcept
+		{
+			return _mm256_and_si256(a, b);
+		}
+#endif
+	};
+
+	struct op_or {
+		static std::uint64_t apply(std::uint64_t a, std::uint64_t b) noexcept
+		{
+			return a | b;
+		}
+#ifdef BITWISE_X86_DISPATCH
+		__attribute__((target("avx2"))) static __m256i apply(__m256i a, __m256i b) noexcept
+		{
+			return _mm256_or_si256(a, b);
+		}
+#endif
+	};
+
+	struct op_xor {
+		static std::uint64_t apply(std::uint64_t a, std::uint64_t b) noexcept
+		{
+			return a ^ b;
+		}
+#ifdef BITWISE_X86_DISPATCH
+		__attribute__((target("avx2"))) static __m256i apply(__m256i a, __m256i b) noexcept
+		{
+			return _mm256_xor_si256(a, b);
+		}
+#endif
+	};
+
+	struct op_andnot {
+		static std::uint64_t apply(std::uint64_t a, std::uint64_t b) noexcept
+		{
+			return a & ~b;
+		}
+#ifdef BITWISE_X86_DISPATCH
+		__attribute__((target("avx2"))) static __m256i apply(__m256i a, __m256i b) noexcept
+		{
+			return _mm256_andnot_si256(b, a);
+		}
+#endif
+	};
+
+	using binary_kernel = void (*)(std::uint64_t *, const std::uint64_t *, const std::uint64_t *, std::size_t);
+	using count_kernel = std::size_t (*)(const std::uint64_t *, std::size_t);
+	using scan_kernel = std::size_t (*)(const std::uint64_t *, std::size_t, std::size_t);
+
+	template<typename OpT>
+	void binary_scalar(std::uint64_t *dst, const std::uint64_t *a, const std::uint64_t *b, std::size_t n)
+	{
+		for (std::size_t i = 0; i < n; ++i)
+			dst[i] = OpT::apply(a[i], b[i]);
+	}
+
+	std::size_t popcount_word(std::uint64_t x) noexcept
+	{
+#ifdef __GNUC__
+		return __builtin_popcountll(x);
+#else
+		x = x - ((x >> 1) & 0x5555555555555555ULL);
+		x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+		x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+		return (x * 0x0101010101010101ULL) >> 56;
+#endif
+	}
+
+	std::size_t ctz_word(std::uint64_t x) noexcept
+	{
+#ifdef __GNUC__
+		return __builtin_ctzll(x);
+#else
+		std::size_t n = 0;
+		while ((x & 1) == 0) {
+			x >>= 1;
+			++n;
+		}
+		return n;
+#endif
+	}
+
+	std::size_t clz_word(std::uint64_t x) noexcept
+	{
+#ifdef __GNUC__
+		return __builtin_clzll(x);
+#else
+		std::size_t n = 0;
+		while ((x & (std::uint64_t(1) << 63)) == 0) {
+			x <<= 1;
+			++n;
+		}
+		return n;
+#endif
+	}
+
+	std::size_t popcount_scalar(const std::uint64_t *data, std::size_t n)
+	{
+		std::size_t count = 0;
+		for (std::size_t i = 0; i < n; ++i)
+			count += popcount_word(data[i]);
+		return count;
+	}
+
+	// Index of the first non-zero word at or after start, n if none
+	std::size_t scan_scalar(const std::uint64_t *data, std::size_t start, std::size_t n)
+	{
+		for (std::size_t i = start; i < n; ++i)
+			if (data[i] != 0)
+				return i;
+		return n;
+	}
+
+#ifdef BITWISE_X86_DISPATCH
+	template<typename OpT>
+	__attribute__((target("avx2"))) void binary_avx2(std::uint64_t *dst, const std::uint64_t *a, const std::uint64_t *b, std::size_t n)
+	{
+		std::size_t i = 0;
+		for (; i + 4 <= n; i += 4) {
+			__m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+			__m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i));
+			_mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), OpT::apply(va, vb));
+		}
+		for (; i < n; ++i)
+			dst[i] = OpT::apply(a[i], b[i]);
+	}
+
+	// Nibble lookup popcount (Mula), summed with SAD into 64-bit lanes
+	__attribute__((target("avx2,popcnt"))) std::size_t popcount_avx2(const std::uint64_t *data, std::size_t n)
+	{
+		const __m256i lookup = _mm256_setr_epi8(
+		                           0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+		                           0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+		const __m256i low_mask = _mm256_set1_epi8(0x0F);
+		__m256i acc = _mm256_setzero_si256();
+		std::size_t i = 0;
+		for (; i + 4 <= n; i += 4) {
+			__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+			__m256i lo = _mm256_and_si256(v, low_mask);
+			__m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low_mask);
+			__m256i cnt = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, lo), _mm256_shuffle_epi8(lookup, hi));
+			acc = _mm256_add_epi64(acc, _mm256_sad_epu8(cnt, _mm256_setzero_si256()));
+		}
+		std::uint64_t lanes[4];
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(lanes), acc);
+		std::size_t count = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+		for (; i < n; ++i)
+			count += _mm_popcnt_u64(data[i]);
+		return count;
+	}
+
+	__attribute__((target("avx2"))) std::size_t scan_avx2(const std::uint64_t *data, std::size_t start, std::size_t n)
+	{
+		std::size_t i = start;
+		for (; i + 4 <= n; i += 4) {
+			__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+			if (!_mm256_testz_si256(v, v))
+				break;
+		}
+		return scan_scalar(data, i, n);
+	}
+
+	bool has_avx2() noexcept
+	{
+		static const bool value = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt");
+		return value;
+	}
+
+	template<typename OpT>
+	binary_kernel select_binary() noexcept
+	{
+		return has_avx2() ? &binary_avx2<OpT> : &binary_scalar<OpT>;
+	}
+
+	count_kernel select_popcount() noexcept
+	{
+		return has_avx2() ? &popcount_avx2 : &popcount_scalar;
+	}
+
+	scan_kernel select_scan() noexcept
+	{
+		return has_avx2() ? &scan_avx2 : &scan_scalar;
+	}
+#else
+	template<typename OpT>
+	binary_kernel select_binary() noexcept
+	{
+		return &binary_scalar<OpT>;
+	}
+
+	count_kernel select_popcount() noexcept
+	{
+		return &popcount_scalar;
+	}
+
+	scan_kernel select_scan() noexcept
+	{
+		return &scan_scalar;
+	}
+#endif
+
+	const binary_kernel bitwise_and = select_binary<op_and>();
+	const binary_kernel bitwise_or = select_binary<op_or>();
+	const binary_kernel bitwise_xor = select_binary<op_xor>();
+	const binary_kernel bitwise_andnot = select_binary<op_andnot>();
+	const count_kernel popcount = select_popcount();
+	const scan_kernel scan_nonzero = select_scan();
+}
+
+// Bit vector with runtime length, bits beyond size() are always zero
+
+class bitvec_t final {
+	static constexpr std::size_t word_bits = 64;
+	std::vector<std::uint64_t> words;
+	std::size_t nbits = 0;
+
+	void check_pos(std::size_t pos) const
+	{
+		if (pos >= nbits)
+			throw cs::lang_error("Bitvec position out of range.");
+	}
+	void check_size(const bitvec_t &other) const
+	{
+		if (nbits != other.nbits)
+			throw cs::lang_error("Unmatched bitvec size.");
+	}
+	void trim() noexcept
+	{
+		if (nbits % word_bits != 0)
+			words.back() &= (std::uint64_t(1) << (nbits % word_bits)) - 1;
+	}
+public:
+	static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+	bitvec_t() = default;
+	explicit bitvec_t(std::size_t size) : words((size + word_bits - 1) / word_bits, 0), nbits(size) {}
+
+	std::size_t size() const noexcept
+	{
+		return nbits;
+	}
+	const std::uint64_t *data() const noexcept
+	{
+		return words.data();
+	}
+	std::uint64_t *data() noexcept
+	{
+		return words.data();
+	}
+	std::size_t word_count() const noexcept
+	{
+		return words.size();
+	}
+	void resize(std::size_t size)
+	{
+		words.resize((size + word_bits - 1) / word_bits, 0);
+		nbits = size;
+		if (!words.empty())
+			trim();
+	}
+	bool test(std::size_t pos) const
+	{
+		check_pos(pos);
+		return (words[pos / word_bits] >> (pos % word_bits)) & 1;
+	}
+	void set(std::size_t pos)
+	{
+		check_pos(pos);
+		words[pos / word_bits] |= std::uint64_t(1) << (pos % word_bits);
+	}
+	void reset(std::size_t pos)
+	{
+		check_pos(pos);
+		words[pos / word_bits] &= ~(std::uint64_t(1) << (pos % word_bits));
+	}
+	void flip(std::size_t pos)
+	{
+		check_pos(pos);
+		words[pos / word_bits] ^= std::uint64_t(1) << (pos % word_bits);
+	}
+	void set_all() noexcept
+	{
+		std::fill(words.begin(), words.end(), ~std::uint64_t(0));
+		if (!words.empty())
+			trim();
+	}
+	void reset_all() noexcept
+	{
+		std::fill(words.begin(), words.end(), 0);
+	}
+	void flip_all() noexcept
+	{
+		for (auto &it : words)
+			it = ~it;
+		if (!words.empty())
+			trim();
+	}
+	std::size_t count() const noexcept
+	{
+		return bitwise_kernels::popcount(words.data(), words.size());
+	}
+	bool any() const noexcept
+	{
+		return bitwise_kernels::scan_nonzero(words.data(), 0, words.size()) != words.size();
+	}
+	bool none() const noexcept
+	{
+		return !any();
+	}
+	bool all() const noexcept
+	{
+		return count() == nbits;
+	}
+	// Number of set bits in [0, pos)
+	std::size_t rank(std::size_t pos) const
+	{
+		if (pos > nbits)
+			throw cs::lang_error("Bitvec position out of range.");
+		std::size_t count = bitwise_kernels::popcount(words.data(), pos / word_bits);
+		if (pos % word_bits != 0)
+			count += bitwise_kernels::popcount_word(words[pos / word_bits] & ((std::uint64_t(1) << (pos % word_bits)) - 1));
+		return count;
+	}
+	// First set bit at or after pos, npos if none
+	std::size_t find_from(std::size_t pos) const noexcept
+	{
+		if (pos >= nbits)
+			return npos;
+		std::size_t idx = pos / word_bits;
+		std::uint64_t word = words[idx] & (~std::uint64_t(0) << (pos % word_bits));
+		if (word != 0)
+			return idx * word_bits + bitwise_kernels::ctz_word(word);
+		idx = bitwise_kernels::scan_nonzero(words.data(), idx + 1, words.size());
+		if (idx == words.size())
+			return npos;
+		return idx * word_bits + bitwise_kernels::ctz_word(words[idx]);
+	}
+	std::size_t find_first() const noexcept
+	{
+		return find_from(0);
+	}
+	std::size_t find_next(std::size_t pos) const noexcept
+	{
+		return pos == npos ? npos : find_from(pos + 1);
+	}
+	void apply(bitwise_kernels::binary_kernel kernel, const bitvec_t &other)
+	{
+		check_size(other);
+		kernel(words.data(), words.data(), other.words.data(), words.size());
+	}
+	void shift_left(std::size_t shift) noexcept
+	{
+		const std::size_t n = words.size(), ws = shift / word_bits, bs = shift % word_bits;
+		if (ws >= n) {
+			reset_all();
+			return;
+		}
+		for (std::size_t i = n; i-- > ws;) {
+			std::uint64_t val = words[i - ws] << bs;
+			if (bs != 0 && i - ws > 0)
+				val |= words[i - ws - 1] >> (word_bits - bs);
+			words[i] = val;
+		}
+		std::fill(words.begin(), words.begin() + ws, 0);
+		trim();
+	}
+	void shift_right(std::size_t shift) noexcept
+	{
+		const std::size_t n = words.size(), ws = shift / word_bits, bs = shift % word_bits;
+		if (ws >= n) {
+			reset_all();
+			return;
+		}
+		for (std::size_t i = 0; i + ws < n; ++i) {
+			std::uint64_t val = words[i + ws] >> bs;
+			if (bs != 0 && i + ws + 1 < n)
+				val |= words[i + ws + 1] << (word_bits - bs);
+			words[i] = val;
+		}
+		std::fill(words.end() - ws, words.end(), 0);
+	}
+	std::string to_string() const
+	{
+		std::string str(nbits, '0');
+		for (std::size_t i = 0; i < nbits; ++i)
+			if ((words[i / word_bits] >> (i % word_bits)) & 1)
+				str[nbits - 1 - i] = '1';
+		return str;
+	}
+	static bitvec_t from_string(const std::string &str)
+	{
+		bitvec_t vec(str.size());
+		for (std::size_t i = 0; i < str.size(); ++i) {
+			char ch = str[str.size() - 1 - i];
+			if (ch == '1')
+				vec.words[i / word_bits] |= std::uint64_t(1) << (i % word_bits);
+			else if (ch != '0')
+				throw cs::lang_error("Wrong bitvec literal.");
+		}
+		return vec;
+	}
+};
+
+template<bitwise_kernels::binary_kernel const &kernel>
+bitvec_t bitvec_binary(const bitvec_t &lhs, const bitvec_t &rhs)
+{
+	bitvec_t ret(lhs);
+	ret.apply(kernel, rhs);
+	return ret;
+}
+
+template<bitwise_kernels::binary_kernel const &kernel>
+void bitvec_assign(bitvec_t &lhs, const bitvec_t &rhs)
+{
+	lhs.apply(kernel, rhs);
+}
+
+cs::numeric bitvec_position(std::size_t pos)
+{
+	if (pos == bitvec_t::npos)
+		return -1;
+	return pos;
+}
+
+// CRC32 (zlib) and CRC32C (Castagnoli), reflected, with streaming state
+
+namespace bitwise_crc {
+	using crc_table = std::array<std::array<std::uint32_t, 256>, 8>;
+	using crc_kernel = std::uint32_t (*)(std::uint32_t, const unsigned char *, std::size_t);
+
+	crc_table make_table(std::uint32_t poly)
+	{
+		crc_table table;
+		for (std::uint32_t i = 0; i < 256; ++i) {
+			std::uint32_t crc = i;
+			for (int k = 0; k < 8; ++k)
+				crc = (crc >> 1) ^ (poly & (0 - (crc & 1)));
+			table[0][i] = crc;
+		}
+		for (std::uint32_t i = 0; i < 256; ++i)
+			for (std::size_t t = 1; t < 8; ++t)
+				table[t][i] = (table[t - 1][i] >> 8) ^ table[0][table[t - 1][i] & 0xFF];
+		return table;
+	}
+
+	const crc_table crc32_table = make_table(0xEDB88320);
+	const crc_table crc32c_table = make_table(0x82F63B78);
+
+	// Slice-by-8 over the raw (non-inverted) register
+	std::uint32_t slice8(const crc_table &table, std::uint32_t crc, const unsigned char *data, std::size_t len)
+	{
+		for (; len >= 8; data += 8, len -= 8) {
+			std::uint32_t lo = crc ^ (std::uint32_t(data[0]) | std::uint32_t(data[1]) << 8 | std::uint32_t(data[2]) << 16 | std::uint32_t(data[3]) << 24);
+			crc = table[7][lo & 0xFF] ^ table[6][(lo >> 8) & 0xFF] ^ table[5][(lo >> 16) & 0xFF] ^ table[4][lo >> 24] ^
+			      table[3][data[4]] ^ table[2][data[5]] ^ table[1][data[6]] ^ table[0][data[7]];
+		}
+		for (; len > 0; ++data, --len)
+			crc = (crc >> 8) ^ table[0][(crc ^ *data) & 0xFF];
+		return crc;
+	}
+
+	std::uint32_t crc32_scalar(std::uint32_t crc, const unsigned char *data, std::size_t len)
+	{
+		return slice8(crc32_table, crc, data, len);
+	}
+
+	std::uint32_t crc32c_scalar(std::uint32_t crc, const unsigned char *data, std::size_t len)
+	{
+		return slice8(crc32c_table, crc, data, len);
+	}
+
+#ifdef BITWISE_X86_DISPATCH
+	// Carry-less multiplication folding (Intel, "Fast CRC Computation for Generic
+	// Polynomials Using PCLMULQDQ"), needs len >= 64 and a multiple of 16
+	__attribute__((target("pclmul,sse4.1"))) std::uint32_t crc32_fold(std::uint32_t crc, const unsigned char *buf, std::size_t len)
+	{
+		alignas(16) static const std::uint64_t k1k2[] = {0x0154442bd4, 0x01c6e41596};
+		alignas(16) static const std::uint64_t k3k4[] = {0x01751997d0, 0x00ccaa009e};
+		alignas(16) static const std::uint64_t k5k0[] = {0x0163cd6124, 0x0000000000};
+		alignas(16) static const std::uint64_t poly[] = {0x01db710641, 0x01f7011641};
+		__m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+
+		x1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(buf + 0x00));
+		x2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(buf + 0x10));
+		x3 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(buf + 0x20));
+		x4 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(buf + 0x30));
+		x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(static_cast<int>(crc)));
+		x0 = _mm_load_si128(reinterpret_cast<const __m128i *>(k1k2));
+		buf += 64;
+		len -= 64;
+
+		// Fold four lanes in parallel
+		for (; len >= 64; buf += 64, len -= 64) {
+			x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+			x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+			x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+			x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+			x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+			x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+			x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+			x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+			x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128(reinterpret_cast<const __m128i *>(buf + 0x00)));
+			x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128(reinterpret_cast<const __m128i *>(buf + 0x10)));
+			x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128(reinterpret_cast<const __m128i *>(buf + 0x20)));
+			x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128(reinterpret_cast<const __m128i *>(buf + 0x30)));
+		}
+
+		// Fold the lanes into 128 bits, then any remaining 16-byte blocks
+		x0 = _mm_load_si128(reinterpret_cast<const __m128i *>(k3k4));
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, x0, 0x11), x2), x5);
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, x0, 0x11), x3), x5);
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, x0, 0x11), x4), x5);
+		for (; len >= 16; buf += 16, len -= 16) {
+			x2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(buf));
+			x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+			x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, x0, 0x11), x2), x5);
+		}
+
+		// Fold 128 bits to 64 bits
+		x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+		x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+		x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+		x0 = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(k5k0));
+		x2 = _mm_srli_si128(x1, 4);
+		x1 = _mm_xor_si128(_mm_clmulepi64_si128(_mm_and_si128(x1, x3), x0, 0x00), x2);
+
+		// Barrett reduction to 32 bits
+		x0 = _mm_load_si128(reinterpret_cast<const __m128i *>(poly));
+		x2 = _mm_clmulepi64_si128(_mm_and_si128(x1, x3), x0, 0x10);
+		x2 = _mm_clmulepi64_si128(_mm_and_si128(x2, x3), x0, 0x00);
+		x1 = _mm_xor_si128(x1, x2);
+		return static_cast<std::uint32_t>(_mm_extract_epi32(x1, 1));
+	}
+
+	std::uint32_t crc32_pclmul(std::uint32_t crc, const unsigned char *data, std::size_t len)
+	{
+		if (len >= 64) {
+			std::size_t blocks = len & ~std::size_t(15);
+			crc = crc32_fold(crc, data, blocks);
+			data += blocks;
+			len -= blocks;
+		}
+		return crc32_scalar(crc, data, len);
+	}
+
+	__attribute__((target("sse4.2"))) std::uint32_t crc32c_sse42(std::uint32_t crc, const unsigned char *data, std::size_t len)
+	{
+#ifdef __x86_64__
+		std::uint64_t crc64 = crc;
+		for (; len >= 8; data += 8, len -= 8) {
+			std::uint64_t word;
+			std::memcpy(&word, data, sizeof(word));
+			crc64 = _mm_crc32_u64(crc64, word);
+		}
+		crc = static_cast<std::uint32_t>(crc64);
+#endif
+		for (; len >= 4; data += 4, len -= 4) {
+			std::uint32_t word;
+			std::memcpy(&word, data, sizeof(word));
+			crc = _mm_crc32_u32(crc, word);
+		}
+		for (; len > 0; ++data, --len)
+			crc = _mm_crc32_u8(crc, *data);
+		return crc;
+	}
+
+	crc_kernel select_crc32() noexcept
+	{
+		return __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1") ? &crc32_pclmul : &crc32_scalar;
+	}
+
+	crc_kernel select_crc32c() noexcept
+	{
+		return __builtin_cpu_supports("sse4.2") ? &crc32c_sse42 : &crc32c_scalar;
+	}
+#else
+	crc_kernel select_crc32() noexcept
+	{
+		return &crc32_scalar;
+	}
+
+	crc_kernel select_crc32c() noexcept
+	{
+		return &crc32c_scalar;
+	}
+#endif
+
+	const crc_kernel crc32_raw = select_crc32();
+	const crc_kernel crc32c_raw = select_crc32c();
+
+	// Takes and returns finished CRC values, so results can be chained
+	std::uint32_t update(crc_kernel kernel, std::uint32_t crc, const std::string &data)
+	{
+		return ~kernel(~crc, reinterpret_cast<const unsigned char *>(data.data()), data.size());
+	}
+
+	cs::numeric update_numeric(crc_kernel kernel, const cs::numeric &crc, const std::string &data)
+	{
+		return update(kernel, static_cast<std::uint32_t>(crc.as_integer()), data);
+	}
+
+	// Null when the file can not be read, so a real CRC of 0 stays distinguishable
+	cs::var checksum_file(crc_kernel kernel, const std::string &path)
+	{
+		constexpr std::size_t block_size = 1 << 20;
+		std::ifstream ifs(path, std::ios_base::in | std::ios_base::binary);
+		if (!ifs)
+			return cs::null_pointer;
+		std::unique_ptr<char[]> block(new char[block_size]);
+		std::uint32_t crc = ~std::uint32_t(0);
+		while (ifs) {
+			ifs.read(block.get(), block_size);
+			std::size_t count = static_cast<std::size_t>(ifs.gcount());
+			if (count == 0)
+				break;
+			crc = kernel(crc, reinterpret_cast<const unsigned char *>(block.get()), count);
+		}
+		if (ifs.bad())
+			return cs::null_pointer;
+		return cs::var::make<cs::numeric>(~crc);
+	}
+}
+
+// Bit expression over named 64-bit inputs, compiled once into postfix code
+
+class bitexpr_t final {
+public:
+	static constexpr std::size_t max_inputs = 64;
+	static constexpr std::size_t max_depth = 64;
+	static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+private:
+	enum class opcode : std::uint8_t {
+		input, constant, op_and, op_or, op_xor, op_not, op_shl, op_shr
+	};
+	struct instruction {
+		opcode op;
+		std::uint64_t operand;
+	};
+	std::string source;
+	std::vector<std::string> names;
+	std::vector<instruction> code;
+	std::size_t depth = 0, nesting = 0;
+	std::size_t cursor = 0;
+
+	[[noreturn]] void error(const std::string &what) const
+	{
+		throw cs::lang_error("Bit expression: " + what + " at column " + std::to_string(cursor + 1) + ".");
+	}
+	void skip_space()
+	{
+		while (cursor < source.size() && std::isspace(static_cast<unsigned char>(source[cursor])))
+			++cursor;
+	}
+	bool accept(const char *token)
+	{
+		skip_space();
+		std::size_t len = std::strlen(token);
+		if (source.compare(cursor, len, token) != 0)
+			return false;
+		cursor += len;
+		return true;
+	}
+	void push(opcode op, std::uint64_t operand = 0)
+	{
+		if (++depth > max_depth)
+			error("expression too deep");
+		code.push_back({op, operand});
+	}
+	static std::uint64_t apply(opcode op, std::uint64_t lhs, std::uint64_t rhs) noexcept
+	{
+		switch (op) {
+		case opcode::op_and:
+			return lhs & rhs;
+		case opcode::op_or:
+			return lhs | rhs;
+		case opcode::op_xor:
+			return lhs ^ rhs;
+		case opcode::op_shl:
+			return rhs >= 64 ? 0 : lhs << rhs;
+		case opcode::op_shr:
+			return rhs >= 64 ? 0 : lhs >> rhs;
+		default:
+			return 0;
+		}
+	}
+	// Binary operators fold when both operands are constants
+	void emit_binary(opcode op)
+	{
+		std::size_t n = code.size();
+		if (code[n - 1].op == opcode::constant && code[n - 2].op == opcode::constant) {
+			code[n - 2].operand = apply(op, code[n - 2].operand, code[n - 1].operand);
+			code.pop_back();
+		}
+		else
+			code.push_back({op, 0});
+		--depth;
+	}
+	void parse_number()
+	{
+		std::size_t begin = cursor;
+		int base = 10;
+		if (source.compare(cursor, 2, "0x") == 0 || source.compare(cursor, 2, "0X") == 0) {
+			base = 16;
+			cursor += 2;
+		}
+		else if (source.compare(cursor, 2, "0b") == 0 || source.compare(cursor, 2, "0B") == 0) {
+			base = 2;
+			cursor += 2;
+		}
+		std::uint64_t value = 0;
+		std::size_t digits = 0;
+		for (; cursor < source.size(); ++cursor, ++digits) {
+			char ch = source[cursor];
+			int digit;
+			if (ch >= '0' && ch <= '9')
+				digit = ch - '0';
+			else if (ch >= 'a' && ch <= 'f')
+				digit = ch - 'a' + 10;
+			else if (ch >= 'A' && ch <= 'F')
+				digit = ch - 'A' + 10;
+			else
+				break;
+			if (digit >= base)
+				break;
+			if (value > (std::numeric_limits<std::uint64_t>::max() - digit) / base) {
+				cursor = begin;
+				error("literal out of range");
+			}
+			value = value * base + digit;
+		}
+		if (digits == 0)
+			error("malformed literal");
+		push(opcode::constant, value);
+	}
+	void parse_primary()
+	{
+		skip_space();
+		if (cursor >= source.size())
+			error("unexpected end");
+		char ch = source[cursor];
+		if ((ch == '(' || ch == '~') && ++nesting > max_depth)
+			error("expression too deep");
+		if (ch == '(') {
+			++cursor;
+			parse_or();
+			if (!accept(")"))
+				error("expect \")\"");
+			--nesting;
+		}
+		else if (ch == '~') {
+			++cursor;
+			parse_primary();
+			if (code.back().op == opcode::constant)
+				code.back().operand = ~code.back().operand;
+			else
+				code.push_back({opcode::op_not, 0});
+			--nesting;
+		}
+		else if (std::isdigit(static_cast<unsigned char>(ch)))
+			parse_number();
+		else if (std::isalpha(static_cast<unsigned char>(ch)) || ch == '_') {
+			std::size_t begin = cursor;
+			while (cursor < source.size() && (std::isalnum(static_cast<unsigned char>(source[cursor])) || source[cursor] == '_'))
+				++cursor;
+			std::string name = source.substr(begin, cursor - begin);
+			std::size_t idx = index_of(name);
+			if (idx == npos) {
+				if (names.size() == max_inputs)
+					error("too many inputs");
+				idx = names.size();
+				names.push_back(name);
+			}
+			push(opcode::input, idx);
+		}
+		else
+			error(std::string("unexpected \"") + ch + "\"");
+	}
+	void parse_shift()
+	{
+		parse_primary();
+		for (;;) {
+			if (accept("<<")) {
+				parse_primary();
+				emit_binary(opcode::op_shl);
+			}
+			else if (accept(">>")) {
+				parse_primary();
+				emit_binary(opcode::op_shr);
+			}
+			else
+				break;
+		}
+	}
+	void parse_and()
+	{
+		parse_shift();
+		while (accept("&")) {
+			parse_shift();
+			emit_binary(opcode::op_and);
+		}
+	}
+	void parse_xor()
+	{
+		parse_and();
+		while (accept("^")) {
+			parse_and();
+			emit_binary(opcode::op_xor);
+		}
+	}
+	void parse_or()
+	{
+		parse_xor();
+		while (accept("|")) {
+			parse_xor();
+			emit_binary(opcode::op_or);
+		}
+	}
+public:
+	explicit bitexpr_t(std::string expr) : source(std::move(expr))
+	{
+		parse_or();
+		skip_space();
+		if (cursor != source.size())
+			error("unexpected trailing input");
+	}
+	const std::string &str() const noexcept
+	{
+		return source;
+	}
+	const std::vector<std::string> &inputs() const noexcept
+	{
+		return names;
+	}
+	std::size_t index_of(const std::string &name) const noexcept
+	{
+		for (std::size_t i = 0; i < names.size(); ++i)
+			if (names[i] == name)
+				return i;
+		return npos;
+	}
+	// Inputs are given in the order of inputs()
+	std::uint64_t eval(const std::uint64_t *values) const noexcept
+	{
+		std::uint64_t stack[max_depth];
+		std::size_t top = 0;
+		for (auto &ins : code) {
+			switch (ins.op) {
+			case opcode::input:
+				stack[top++] = values[ins.operand];
+				break;
+			case opcode::constant:
+				stack[top++] = ins.operand;
+				break;
+			case opcode::op_not:
+				stack[top - 1] = ~stack[top - 1];
+				break;
+			default:
+				--top;
+				stack[top - 1] = apply(ins.op, stack[top - 1], stack[top]);
+				break;
+			}
+		}
+		return stack[0];
+	}
+};
+
+using bitexpr_type = std::shared_ptr<bitexpr_t>;
+
+// Bitsets and integers are both accepted where a 64-bit word is expected
+std::uint64_t to_word(const cs::var &val)
+{
+	if (val.type() == typeid(bitset_t))
+		return val.const_val<bitset_t>().to_ullong();
+	if (val.type() == typeid(cs::numeric) && val.const_val<cs::numeric>().is_integer())
+		return static_cast<std::uint64_t>(val.const_val<cs::numeric>().as_integer());
+	throw cs::lang_error("Expect bitset or integer.");
+}
+
+// Roaring bitmap over 32-bit values: one container per 16-bit high part,
+// stored as a sorted array, a 65536-bit bitmap or a list of runs
+
+namespace bitwise_roaring {
+	constexpr std::size_t bitmap_words = 1024;
+	constexpr std::uint32_t array_max = 4096;
+	// Cookies of the portable Roaring format (RoaringFormatSpec)
+	constexpr std::uint32_t cookie_no_run = 12346;
+	constexpr std::uint32_t cookie_run = 12347;
+	constexpr std::uint32_t no_offset_threshold = 4;
+
+	enum class kind : std::uint8_t {
+		array, bitmap, run
+	};
+
+	// Runs are stored as (start, length - 1) pairs
+	struct container {
+		kind type = kind::array;
+		std::uint32_t card = 0;
+		std::vector<std::uint16_t> data;
+		std::vector<std::uint64_t> words;
+	};
+
+	enum class setop {
+		op_and, op_or, op_xor, op_andnot
+	};
+
+	void set_range(std::uint64_t *words, std::uint32_t lo, std::uint32_t hi)
+	{
+		// Sets [lo, hi], both inclusive
+		std::uint32_t first = lo / 64, last = hi / 64;
+		std::uint64_t head = ~std::uint64_t(0) << (lo % 64), tail = ~std::uint64_t(0) >> (63 - hi % 64);
+		if (first == last) {
+			words[first] |= head & tail;
+			return;
+		}
+		words[first] |= head;
+		for (std::uint32_t i = first + 1; i < last; ++i)
+			words[i] = ~std::uint64_t(0);
+		words[last] |= tail;
+	}
+
+	void fill_words(const container &c, std::uint64_t *words)
+	{
+		switch (c.type) {
+		case kind::bitmap:
+			std::memcpy(words, c.words.data(), bitmap_words * sizeof(std::uint64_t));
+			break;
+		case kind::array:
+			std::memset(words, 0, bitmap_words * sizeof(std::uint64_t));
+			for (auto v : c.data)
+				words[v / 64] |= std::uint64_t(1) << (v % 64);
+			break;
+		case kind::run:
+			std::memset(words, 0, bitmap_words * sizeof(std::uint64_t));
+			for (std::size_t i = 0; i < c.data.size(); i += 2)
+				set_range(words, c.data[i], std::uint32_t(c.data[i]) + c.data[i + 1]);
+			break;
+		}
+	}
+
+	template<typename FuncT>
+	void for_each_value(const container &c, FuncT &&func)
+	{
+		switch (c.type) {
+		case kind::array:
+			for (auto v : c.data)
+				func(v);
+			break;
+		case kind::bitmap:
+			for (std::size_t i = 0; i < bitmap_words; ++i)
+				for (std::uint64_t w = c.words[i]; w != 0; w &= w - 1)
+					func(static_cast<std::uint16_t>(i * 64 + bitwise_kernels::ctz_word(w)));
+			break;
+		case kind::run:
+			for (std::size_t i = 0; i < c.data.size(); i += 2)
+				for (std::uint32_t v = c.data[i], end = v + c.data[i + 1]; v <= end; ++v)
+					func(static_cast<std::uint16_t>(v));
+			break;
+		}
+	}
+
+	void make_array(container &c)
+	{
+		if (c.type == kind::array)
+			return;
+		std::vector<std::uint16_t> values;
+		values.reserve(c.card);
+		for_each_value(c, [&values](std::uint16_t v) {
+			values.push_back(v);
+		});
+		c.data.swap(values);
+		c.words.clear();
+		c.words.shrink_to_fit();
+		c.type = kind::array;
+	}
+
+	void make_bitmap(container &c)
+	{
+		if (c.type == kind::bitmap)
+			return;
+		c.words.resize(bitmap_words);
+		fill_words(c, c.words.data());
+		c.data.clear();
+		c.data.shrink_to_fit();
+		c.type = kind::bitmap;
+	}
+
+	// Restores the array/bitmap invariant for non-run containers
+	void normalize(container &c)
+	{
+		if (c.type == kind::bitmap && c.card <= array_max)
+			make_array(c);
+		else if (c.type == kind::array && c.card > array_max)
+			make_bitmap(c);
+	}
+
+	// Run containers are expanded before point updates
+	void unpack(container &c)
+	{
+		if (c.type != kind::run)
+			return;
+		if (c.card <= array_max)
+			make_array(c);
+		else
+			make_bitmap(c);
+	}
+
+	std::size_t count_runs(const container &c)
+	{
+		switch (c.type) {
+		case kind::run:
+			return c.data.size() / 2;
+		case kind::array: {
+			std::size_t runs = c.data.empty() ? 0 : 1;
+			for (std::size_t i = 1; i < c.data.size(); ++i)
+				if (c.data[i] != c.data[i - 1] + 1)
+					++runs;
+			return runs;
+		}
+		default: {
+			std::size_t runs = 0;
+			std::uint64_t carry = 0;
+			for (auto w : c.words) {
+				runs += bitwise_kernels::popcount_word(w & ~((w << 1) | carry));
+				carry = w >> 63;
+			}
+			return runs;
+		}
+		}
+	}
+
+	void make_run(container &c)
+	{
+		if (c.type == kind::run)
+			return;
+		std::vector<std::uint16_t> runs;
+		std::uint32_t start = 0, prev = 0;
+		bool open = false;
+		for_each_value(c, [&](std::uint16_t v) {
+			if (open && v == prev + 1) {
+				prev = v;
+				return;
+			}
+			if (open) {
+				runs.push_back(static_cast<std::uint16_t>(start));
+				runs.push_back(static_cast<std::uint16_t>(prev - start));
+			}
+			start = prev = v;
+			open = true;
+		});
+		if (open) {
+			runs.push_back(static_cast<std::uint16_t>(start));
+			runs.push_back(static_cast<std::uint16_t>(prev - start));
+		}
+		c.data.swap(runs);
+		c.words.clear();
+		c.words.shrink_to_fit();
+		c.type = kind::run;
+	}
+
+	// Picks the smallest serialized representation
+	void optimize(container &c)
+	{
+		std::size_t run_bytes = 2 + 4 * count_runs(c);
+		std::size_t plain_bytes = c.card <= array_max ? 2 * c.card : 8192;
+		if (run_bytes < plain_bytes)
+			make_run(c);
+		else if (c.type == kind::run)
+			unpack(c);
+	}
+
+	std::size_t serialized_bytes(const container &c)
+	{
+		switch (c.type) {
+		case kind::array:
+			return 2 * c.data.size();
+		case kind::bitmap:
+			return 8192;
+		default:
+			return 2 + 2 * c.data.size();
+		}
+	}
+
+	bool contains(const container &c, std::uint16_t v)
+	{
+		switch (c.type) {
+		case kind::array:
+			return std::binary_search(c.data.begin(), c.data.end(), v);
+		case kind::bitmap:
+			return (c.words[v / 64] >> (v % 64)) & 1;
+		default: {
+			// Last run starting at or before v
+			std::size_t lo = 0, hi = c.data.size() / 2;
+			while (lo < hi) {
+				std::size_t mid = (lo + hi) / 2;
+				if (c.data[mid * 2] <= v)
+					lo = mid + 1;
+				else
+					hi = mid;
+			}
+			return lo > 0 && v <= std::uint32_t(c.data[(lo - 1) * 2]) + c.data[(lo - 1) * 2 + 1];
+		}
+		}
+	}
+
+	// Smallest value >= v, or -1
+	std::int32_t next_value(const container &c, std::uint16_t v)
+	{
+		switch (c.type) {
+		case kind::array: {
+			auto it = std::lower_bound(c.data.begin(), c.data.end(), v);
+			return it == c.data.end() ? -1 : *it;
+		}
+		case kind::bitmap: {
+			std::size_t idx = v / 64;
+			std::uint64_t w = c.words[idx] & (~std::uint64_t(0) << (v % 64));
+			while (w == 0) {
+				if (++idx == bitmap_words)
+					return -1;
+				w = c.words[idx];
+			}
+			return static_cast<std::int32_t>(idx * 64 + bitwise_kernels::ctz_word(w));
+		}
+		default:
+			for (std::size_t i = 0; i < c.data.size(); i += 2) {
+				std::uint32_t end = std::uint32_t(c.data[i]) + c.data[i + 1];
+				if (v <= end)
+					return std::max<std::int32_t>(v, c.data[i]);
+			}
+			return -1;
+		}
+	}
+
+	bool add(container &c, std::uint16_t v)
+	{
+		unpack(c);
+		if (c.type == kind::bitmap) {
+			std::uint64_t &w = c.words[v / 64], bit = std::uint64_t(1) << (v % 64);
+			if (w & bit)
+				return false;
+			w |= bit;
+		}
+		else {
+			auto it = std::lower_bound(c.data.begin(), c.data.end(), v);
+			if (it != c.data.end() && *it == v)
+				return false;
+			c.data.insert(it, v);
+		}
+		++c.card;
+		normalize(c);
+		return true;
+	}
+
+	bool remove(container &c, std::uint16_t v)
+	{
+		unpack(c);
+		if (c.type == kind::bitmap) {
+			std::uint64_t &w = c.words[v / 64], bit = std::uint64_t(1) << (v % 64);
+			if (!(w & bit))
+				return false;
+			w &= ~bit;
+		}
+		else {
+			auto it = std::lower_bound(c.data.begin(), c.data.end(), v);
+			if (it == c.data.end() || *it != v)
+				return false;
+			c.data.erase(it);
+		}
+		--c.card;
+		normalize(c);
+		return true;
+	}
+
+	container array_filter(const container &a, const container &b, bool keep)
+	{
+		container ret;
+		for (auto v : a.data)
+			if (contains(b, v) == keep)
+				ret.data.push_back(v);
+		ret.card = static_cast<std::uint32_t>(ret.data.size());
+		return ret;
+	}
+
+	container combine(const container &a, const container &b, setop op)
+	{
+		if (a.type == kind::array && b.type == kind::array) {
+			container ret;
+			auto out = std::back_inserter(ret.data);
+			switch (op) {
+			case setop::op_and:
+				std::set_intersection(a.data.begin(), a.data.end(), b.data.begin(), b.data.end(), out);
+				break;
+			case setop::op_or:
+				std::set_union(a.data.begin(), a.data.end(), b.data.begin(), b.data.end(), out);
+				break;
+			case setop::op_xor:
+				std::set_symmetric_difference(a.data.begin(), a.data.end(), b.data.begin(), b.data.end(), out);
+				break;
+			case setop::op_andnot:
+				std::set_difference(a.data.begin(), a.data.end(), b.data.begin(), b.data.end(), out);
+				break;
+			}
+			ret.card = static_cast<std::uint32_t>(ret.data.size());
+			normalize(ret);
+			return ret;
+		}
+		if (op == setop::op_and && a.type == kind::array)
+			return array_filter(a, b, true);
+		if (op == setop::op_and && b.type == kind::array)
+			return array_filter(b, a, true);
+		if (op == setop::op_andnot && a.type == kind::array)
+			return array_filter(a, b, false);
+		// Everything else goes through 65536-bit word kernels
+		container ret;
+		ret.type = kind::bitmap;
+		ret.words.resize(bitmap_words);
+		std::array<std::uint64_t, bitmap_words> lhs, rhs;
+		const std::uint64_t *pa = a.words.data(), *pb = b.words.data();
+		if (a.type != kind::bitmap) {
+			fill_words(a, lhs.data());
+			pa = lhs.data();
+		}
+		if (b.type != kind::bitmap) {
+			fill_words(b, rhs.data());
+			pb = rhs.data();
+		}
+		switch (op) {
+		case setop::op_and:
+			bitwise_kernels::bitwise_and(ret.words.data(), pa, pb, bitmap_words);
+			break;
+		case setop::op_or:
+			bitwise_kernels::bitwise_or(ret.words.data(), pa, pb, bitmap_words);
+			break;
+		case setop::op_xor:
+			bitwise_kernels::bitwise_xor(ret.words.data(), pa, pb, bitmap_words);
+			break;
+		case setop::op_andnot:
+			bitwise_kernels::bitwise_andnot(ret.words.data(), pa, pb, bitmap_words);
+			break;
+		}
+		ret.card = static_cast<std::uint32_t>(bitwise_kernels::popcount(ret.words.data(), bitmap_words));
+		normalize(ret);
+		return ret;
+	}
+
+	void put16(std::string &out, std::uint16_t v)
+	{
+		out.push_back(static_cast<char>(v & 0xFF));
+		out.push_back(static_cast<char>(v >> 8));
+	}
+
+	void put32(std::string &out, std::uint32_t v)
+	{
+		put16(out, static_cast<std::uint16_t>(v & 0xFFFF));
+		put16(out, static_cast<std::uint16_t>(v >> 16));
+	}
+
+	class reader {
+		const unsigned char *ptr, *end;
+	public:
+		explicit reader(const std::string &str) : ptr(reinterpret_cast<const unsigned char *>(str.data())), end(ptr + str.size()) {}
+		const unsigned char *take(std::size_t n)
+		{
+			if (static_cast<std::size_t>(end - ptr) < n)
+				throw cs::lang_error("Corrupted roaring bitmap.");
+			const unsigned char *ret = ptr;
+			ptr += n;
+			return ret;
+		}
+		std::uint16_t u16()
+		{
+			const unsigned char *p = take(2);
+			return static_cast<std::uint16_t>(p[0] | p[1] << 8);
+		}
+		std::uint32_t u32()
+		{
+			std::uint32_t lo = u16();
+			return lo | std::uint32_t(u16()) << 16;
+		}
+		// Bulk little-endian load, a plain copy on little-endian hosts
+		template<typename T>
+		void load(std::vector<T> &dst, std::size_t count)
+		{
+			const unsigned char *p = take(count * sizeof(T));
+			dst.resize(count);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+			std::memcpy(dst.data(), p, count * sizeof(T));
+#else
+			for (std::size_t i = 0; i < count; ++i) {
+				T v = 0;
+				for (std::size_t b = 0; b < sizeof(T); ++b)
+					v |= T(p[i * sizeof(T) + b]) << (8 * b);
+				dst[i] = v;
+			}
+#endif
+		}
+		bool done() const noexcept
+		{
+			return ptr == end;
+		}
+	};
+}
+
+class roaring_t final {
+	using container = bitwise_roaring::container;
+	std::vector<std::uint16_t> keys;
+	std::vector<container> containers;
+
+	std::size_t find(std::uint16_t key) const noexcept
+	{
+		auto it = std::lower_bound(keys.begin(), keys.end(), key);
+		return static_cast<std::size_t>(it - keys.begin());
+	}
+	container &get_or_create(std::uint16_t key)
+	{
+		// Appending in key order is the common case of bulk loads
+		if (!keys.empty() && keys.back() == key)
+			return containers.back();
+		std::size_t idx = find(key);
+		if (idx == keys.size() || keys[idx] != key) {
+			keys.insert(keys.begin() + idx, key);
+			containers.emplace(containers.begin() + idx);
+		}
+		return containers[idx];
+	}
+	void erase_if_empty(std::size_t idx)
+	{
+		if (containers[idx].card == 0) {
+			keys.erase(keys.begin() + idx);
+			containers.erase(containers.begin() + idx);
+		}
+	}
+	void push(std::uint16_t key, container &&c)
+	{
+		if (c.card != 0) {
+			keys.push_back(key);
+			containers.push_back(std::move(c));
+		}
+	}
+public:
+	static roaring_t combine(const roaring_t &a, const roaring_t &b, bitwise_roaring::setop op)
+	{
+		using bitwise_roaring::setop;
+		roaring_t ret;
+		std::size_t i = 0, j = 0;
+		while (i < a.keys.size() || j < b.keys.size()) {
+			if (j == b.keys.size() || (i < a.keys.size() && a.keys[i] < b.keys[j])) {
+				if (op != setop::op_and)
+					ret.push(a.keys[i], container(a.containers[i]));
+				++i;
+			}
+			else if (i == a.keys.size() || b.keys[j] < a.keys[i]) {
+				if (op == setop::op_or || op == setop::op_xor)
+					ret.push(b.keys[j], container(b.containers[j]));
+				++j;
+			}
+			else {
+				ret.push(a.keys[i], bitwise_roaring::combine(a.containers[i], b.containers[j], op));
+				++i;
+				++j;
+			}
+		}
+		return ret;
+	}
+
+	bool add(std::uint32_t v)
+	{
+		return bitwise_roaring::add(get_or_create(static_cast<std::uint16_t>(v >> 16)), static_cast<std::uint16_t>(v));
+	}
+	bool remove(std::uint32_t v)
+	{
+		std::size_t idx = find(static_cast<std::uint16_t>(v >> 16));
+		if (idx == keys.size() || keys[idx] != v >> 16)
+			return false;
+		bool ret = bitwise_roaring::remove(containers[idx], static_cast<std::uint16_t>(v));
+		erase_if_empty(idx);
+		return ret;
+	}
+	bool contains(std::uint32_t v) const
+	{
+		std::size_t idx = find(static_cast<std::uint16_t>(v >> 16));
+		return idx != keys.size() && keys[idx] == v >> 16 && bitwise_roaring::contains(containers[idx], static_cast<std::uint16_t>(v));
+	}
+	// Adds [lo, hi), whole chunks become a single run
+	void add_range(std::uint64_t lo, std::uint64_t hi)
+	{
+		while (lo < hi) {
+			std::uint16_t key = static_cast<std::uint16_t>(lo >> 16);
+			std::uint64_t chunk_end = std::min<std::uint64_t>(hi, (std::uint64_t(key) + 1) << 16);
+			container &c = get_or_create(key);
+			if (lo % 65536 == 0 && chunk_end - lo == 65536) {
+				c = container();
+				c.type = bitwise_roaring::kind::run;
+				c.data = {0, 65535};
+				c.card = 65536;
+			}
+			else {
+				bitwise_roaring::make_bitmap(c);
+				bitwise_roaring::set_range(c.words.data(), lo % 65536, (chunk_end - 1) % 65536);
+				c.card = static_cast<std::uint32_t>(bitwise_kernels::popcount(c.words.data(), bitwise_roaring::bitmap_words));
+				bitwise_roaring::normalize(c);
+			}
+			lo = chunk_end;
+		}
+	}
+	std::uint64_t cardinality() const noexcept
+	{
+		std::uint64_t card = 0;
+		for (auto &c : containers)
+			card += c.card;
+		return card;
+	}
+	bool empty() const noexcept
+	{
+		return keys.empty();
+	}
+	void clear() noexcept
+	{
+		keys.clear();
+		containers.clear();
+	}
+	// Smallest value >= v, or -1
+	std::int64_t next_value(std::uint32_t v) const
+	{
+		for (std::size_t idx = find(static_cast<std::uint16_t>(v >> 16)); idx < keys.size(); ++idx) {
+			std::uint16_t low = keys[idx] == v >> 16 ? static_cast<std::uint16_t>(v) : 0;
+			std::int32_t found = bitwise_roaring::next_value(containers[idx], low);
+			if (found >= 0)
+				return std::int64_t(keys[idx]) << 16 | found;
+		}
+		return -1;
+	}
+	std::int64_t min() const
+	{
+		return next_value(0);
+	}
+	std::int64_t max() const
+	{
+		if (keys.empty())
+			return -1;
+		std::int32_t last = 0;
+		bitwise_roaring::for_each_value(containers.back(), [&last](std::uint16_t v) {
+			last = v;
+		});
+		return std::int64_t(keys.back()) << 16 | last;
+	}
+	template<typename FuncT>
+	void for_each(FuncT &&func) const
+	{
+		for (std::size_t i = 0; i < keys.size(); ++i) {
+			std::uint32_t high = std::uint32_t(keys[i]) << 16;
+			bitwise_roaring::for_each_value(containers[i], [&](std::uint16_t v) {
+				func(high | v);
+			});
+		}
+	}
+	void optimize()
+	{
+		for (auto &c : containers)
+			bitwise_roaring::optimize(c);
+	}
+	bool equals(const roaring_t &other) const
+	{
+		if (keys != other.keys)
+			return false;
+		for (std::size_t i = 0; i < keys.size(); ++i) {
+			const container &a = containers[i], &b = other.containers[i];
+			if (a.card != b.card || bitwise_roaring::combine(a, b, bitwise_roaring::setop::op_xor).card != 0)
+				return false;
+		}
+		return true;
+	}
+	std::string serialize() const
+	{
+		using namespace bitwise_roaring;
+		const std::uint32_t size = static_cast<std::uint32_t>(keys.size());
+		bool has_run = std::any_of(containers.begin(), containers.end(), [](const container &c) {
+			return c.type == kind::run;
+		});
+		std::string out;
+		if (has_run) {
+			put32(out, cookie_run | ((size - 1) << 16));
+			std::string run_flags((size + 7) / 8, '\0');
+			for (std::size_t i = 0; i < size; ++i)
+				if (containers[i].type == kind::run)
+					run_flags[i / 8] |= static_cast<char>(1 << (i % 8));
+			out += run_flags;
+		}
+		else {
+			put32(out, cookie_no_run);
+			put32(out, size);
+		}
+		for (std::size_t i = 0; i < size; ++i) {
+			put16(out, keys[i]);
+			put16(out, static_cast<std::uint16_t>(containers[i].card - 1));
+		}
+		if (!has_run || size >= no_offset_threshold) {
+			std::uint32_t offset = static_cast<std::uint32_t>(out.size() + 4 * size);
+			for (auto &c : containers) {
+				put32(out, offset);
+				offset += static_cast<std::uint32_t>(serialized_bytes(c));
+			}
+		}
+		for (auto &c : containers) {
+			switch (c.type) {
+			case kind::array:
+				for (auto v : c.data)
+					put16(out, v);
+				break;
+			case kind::bitmap:
+				for (auto w : c.words) {
+					put32(out, static_cast<std::uint32_t>(w));
+					put32(out, static_cast<std::uint32_t>(w >> 32));
+				}
+				break;
+			case kind::run:
+				put16(out, static_cast<std::uint16_t>(c.data.size() / 2));
+				for (auto v : c.data)
+					put16(out, v);
+				break;
+			}
+		}
+		return out;
+	}
+	static roaring_t deserialize(const std::string &str)
+	{
+		using namespace bitwise_roaring;
+		const cs::lang_error corrupted("Corrupted roaring bitmap.");
+		reader in(str);
+		roaring_t ret;
+		std::uint32_t cookie = in.u32(), size = 0;
+		std::vector<std::uint8_t> run_flags;
+		bool has_run = (cookie & 0xFFFF) == cookie_run;
+		if (has_run) {
+			size = (cookie >> 16) + 1;
+			const unsigned char *flags = in.take((size + 7) / 8);
+			run_flags.assign(flags, flags + (size + 7) / 8);
+		}
+		else if (cookie == cookie_no_run)
+			size = in.u32();
+		else
+			throw corrupted;
+		if (size > 65536)
+			throw corrupted;
+		ret.keys.resize(size);
+		ret.containers.resize(size);
+		for (std::size_t i = 0; i < size; ++i) {
+			ret.keys[i] = in.u16();
+			ret.containers[i].card = std::uint32_t(in.u16()) + 1;
+			if (i > 0 && ret.keys[i] <= ret.keys[i - 1])
+				throw corrupted;
+		}
+		if (!has_run || size >= no_offset_threshold)
+			in.take(4 * std::size_t(size));
+		for (std::size_t i = 0; i < size; ++i) {
+			container &c = ret.containers[i];
+			if (has_run && (run_flags[i / 8] >> (i % 8)) & 1) {
+				c.type = kind::run;
+				in.load(c.data, 2 * std::size_t(in.u16()));
+				std::uint32_t card = 0, next = 0;
+				for (std::size_t k = 0; k < c.data.size(); k += 2) {
+					std::uint32_t start = c.data[k], end = start + c.data[k + 1];
+					if ((k > 0 && start < next) || end > 65535)
+						throw corrupted;
+					card += end - start + 1;
+					next = end + 2;
+				}
+				if (card != c.card)
+					throw corrupted;
+			}
+			else if (c.card > array_max) {
+				c.type = kind::bitmap;
+				in.load(c.words, bitmap_words);
+				if (bitwise_kernels::popcount(c.words.data(), bitmap_words) != c.card)
+					throw corrupted;
+			}
+			else {
+				in.load(c.data, c.card);
+				for (std::size_t k = 1; k < c.data.size(); ++k)
+					if (c.data[k] <= c.data[k - 1])
+						throw corrupted;
+			}
+		}
+		if (!in.done())
+			throw corrupted;
+		return ret;
+	}
+};
+
+std::uint32_t roaring_value(const cs::numeric &val)
+{
+	if (!val.is_integer() || val.as_integer() < 0 || val.as_integer() > std::numeric_limits<std::uint32_t>::max())
+		throw cs::lang_error("Roaring bitmap values must be integers in [0, 2^32).");
+	return static_cast<std::uint32_t>(val.as_integer());
+}
+
+template<bitwise_roaring::setop op>
+roaring_t roaring_binary(const roaring_t &lhs, const roaring_t &rhs)
+{
+	return roaring_t::combine(lhs, rhs, op);
+}
+
+template<bitwise_roaring::setop op>
+void roaring_assign(roaring_t &lhs, const roaring_t &rhs)
+{
+	lhs = roaring_t::combine(lhs, rhs, op);
+}
+
+// Integer column codecs: LEB128 varint, zigzag, fixed-width bit-packing,
+// frame-of-reference and delta, all over byte strings
+
+namespace bitwise_codec {
+	// Width 0 blocks carry no payload, so their element count is capped
+	// explicitly instead of being bounded by the input size
+	constexpr std::uint64_t max_zero_width_count = std::uint64_t(1) << 24;
+
+	std::uint64_t zigzag(std::int64_t v) noexcept
+	{
+		return (static_cast<std::uint64_t>(v) << 1) ^ static_cast<std::uint64_t>(v >> 63);
+	}
+
+	std::int64_t unzigzag(std::uint64_t v) noexcept
+	{
+		return static_cast<std::int64_t>(v >> 1) ^ -static_cast<std::int64_t>(v & 1);
+	}
+
+	unsigned bit_width(std::uint64_t v) noexcept
+	{
+		unsigned width = 0;
+		for (; v != 0; v >>= 1)
+			++width;
+		return width;
+	}
+
+	std::size_t packed_bytes(std::size_t count, unsigned width) noexcept
+	{
+		return (count * width + 7) / 8;
+	}
+
+	void put_varint(std::string &out, std::uint64_t v)
+	{
+		while (v >= 0x80) {
+			out.push_back(static_cast<char>(v | 0x80));
+			v >>= 7;
+		}
+		out.push_back(static_cast<char>(v));
+	}
+
+	class reader {
+		const unsigned char *ptr, *end;
+	public:
+		explicit reader(const std::string &str) : ptr(reinterpret_cast<const unsigned char *>(str.data())), end(ptr + str.size()) {}
+		std::uint64_t varint()
+		{
+			std::uint64_t v = 0;
+			for (unsigned shift = 0; shift < 64; shift += 7) {
+				if (ptr == end)
+					throw cs::lang_error("Truncated varint.");
+				std::uint64_t byte = *ptr++;
+				v |= (byte & 0x7F) << shift;
+				if (!(byte & 0x80))
+					return v;
+			}
+			throw cs::lang_error("Varint too long.");
+		}
+		// Runs of single-byte varints are decoded eight at a time
+		void varints(std::vector<std::uint64_t> &out)
+		{
+			while (ptr != end) {
+				std::uint64_t word;
+				if (end - ptr >= 8 && (std::memcpy(&word, ptr, 8), (word & 0x8080808080808080ULL) == 0)) {
+					for (int i = 0; i < 8; ++i)
+						out.push_back(ptr[i]);
+					ptr += 8;
+				}
+				else
+					out.push_back(varint());
+			}
+		}
+		std::uint8_t byte()
+		{
+			if (ptr == end)
+				throw cs::lang_error("Truncated codec data.");
+			return *ptr++;
+		}
+		const unsigned char *take(std::size_t n)
+		{
+			if (static_cast<std::size_t>(end - ptr) < n)
+				throw cs::lang_error("Truncated codec data.");
+			const unsigned char *ret = ptr;
+			ptr += n;
+			return ret;
+		}
+		bool done() const noexcept
+		{
+			return ptr == end;
+		}
+	};
+
+	// LSB-first bit stream, width in [0, 64]
+	void pack(std::string &out, const std::uint64_t *values, std::size_t count, unsigned width)
+	{
+		const std::uint64_t mask = width == 64 ? ~std::uint64_t(0) : (std::uint64_t(1) << width) - 1;
+		std::size_t start = out.size();
+		out.reserve(start + packed_bytes(count, width));
+		std::uint64_t acc = 0;
+		unsigned filled = 0;
+		for (std::size_t i = 0; i < count && width != 0; ++i) {
+			std::uint64_t v = values[i] & mask;
+			acc |= v << filled;
+			if (filled + width >= 64) {
+				for (int b = 0; b < 8; ++b)
+					out.push_back(static_cast<char>(acc >> (8 * b)));
+				acc = filled == 0 ? 0 : v >> (64 - filled);
+				filled = filled + width - 64;
+			}
+			else
+				filled += width;
+		}
+		for (unsigned b = 0; b < filled; b += 8)
+			out.push_back(static_cast<char>(acc >> b));
+	}
+
+	std::uint64_t load_bytes(const unsigned char *data, std::size_t size, std::size_t pos) noexcept
+	{
+		std::uint64_t v = 0;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		if (pos + 8 <= size)
+			std::memcpy(&v, data + pos, 8);
+		else
+#endif
+			for (std::size_t b = 0; b < 8 && pos + b < size; ++b)
+				v |= std::uint64_t(data[pos + b]) << (8 * b);
+		return v;
+	}
+
+	void unpack_scalar(const unsigned char *data, std::size_t size, std::uint64_t *out, std::size_t begin, std::size_t count, unsigned width)
+	{
+		const std::uint64_t mask = width == 64 ? ~std::uint64_t(0) : (std::uint64_t(1) << width) - 1;
+		for (std::size_t i = begin; i < count; ++i) {
+			std::size_t bit = i * width, pos = bit / 8;
+			unsigned shift = bit % 8;
+			std::uint64_t v = load_bytes(data, size, pos) >> shift;
+			if (shift + width > 64)
+				v |= std::uint64_t(data[pos + 8]) << (64 - shift);
+			out[i] = v & mask;
+		}
+	}
+
+	using unpack_kernel = void (*)(const unsigned char *, std::size_t, std::uint64_t *, std::size_t, unsigned);
+
+	void unpack_portable(const unsigned char *data, std::size_t size, std::uint64_t *out, std::size_t count, unsigned width)
+	{
+		unpack_scalar(data, size, out, 0, count, width);
+	}
+
+#ifdef BITWISE_X86_DISPATCH
+	// Eight lanes per step: gather 32 bits at each value's byte offset, then
+	// shift and mask, which covers every width up to 25 bits
+	__attribute__((target("avx2"))) void unpack_avx2(const unsigned char *data, std::size_t size, std::uint64_t *out, std::size_t count, unsigned width)
+	{
+		std::size_t i = 0;
+		if (width <= 25 && count >= 8) {
+			const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+			const __m256i step = _mm256_set1_epi32(static_cast<int>(width));
+			const __m256i mask = _mm256_set1_epi32(static_cast<int>((1u << width) - 1));
+			const __m256i seven = _mm256_set1_epi32(7);
+			const __m256i lane_bits = _mm256_mullo_epi32(lanes, step);
+			// The last gather of a block reads 4 bytes from its byte offset
+			for (; i + 8 <= count && ((i + 7) * width) / 8 + 4 <= size; i += 8) {
+				const std::size_t base_bit = i * width;
+				const unsigned char *base = data + base_bit / 8;
+				__m256i bits = _mm256_add_epi32(lane_bits, _mm256_set1_epi32(static_cast<int>(base_bit % 8)));
+				__m256i words = _mm256_i32gather_epi32(reinterpret_cast<const int *>(base), _mm256_srli_epi32(bits, 3), 1);
+				__m256i vals = _mm256_and_si256(_mm256_srlv_epi32(words, _mm256_and_si256(bits, seven)), mask);
+				_mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), _mm256_cvtepu32_epi64(_mm256_castsi256_si128(vals)));
+				_mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i + 4), _mm256_cvtepu32_epi64(_mm256_extracti128_si256(vals, 1)));
+			}
+		}
+		unpack_scalar(data, size, out, i, count, width);
+	}
+
+	unpack_kernel select_unpack() noexcept
+	{
+		return bitwise_kernels::has_avx2() ? &unpack_avx2 : &unpack_portable;
+	}
+#else
+	unpack_kernel select_unpack() noexcept
+	{
+		return &unpack_portable;
+	}
+#endif
+
+	const unpack_kernel unpack = select_unpack();
+
+	std::int64_t to_integer(const cs::var &val)
+	{
+		if (val.type() != typeid(cs::numeric) || !val.const_val<cs::numeric>().is_integer())
+			throw cs::lang_error("Codec input must be an array of integers.");
+		return val.const_val<cs::numeric>().as_integer();
+	}
+
+	std::vector<std::int64_t> to_integers(const cs::array &arr)
+	{
+		std::vector<std::int64_t> values;
+		values.reserve(arr.size());
+		for (auto &it : arr)
+			values.push_back(to_integer(it));
+		return values;
+	}
+
+	template<typename T>
+	cs::var to_array(const std::vector<T> &values)
+	{
+		cs::var ret = cs::var::make<cs::array>();
+		cs::array &arr = ret.val<cs::array>();
+		for (auto v : values)
+			arr.emplace_back(cs::numeric(static_cast<std::int64_t>(v)));
+		return ret;
+	}
+
+	// Layout: varint count, zigzag varint reference, width byte, packed offsets
+	void for_encode(std::string &out, const std::vector<std::int64_t> &values)
+	{
+		std::int64_t ref = values.empty() ? 0 : *std::min_element(values.begin(), values.end());
+		std::vector<std::uint64_t> offsets(values.size());
+		std::uint64_t span = 0;
+		for (std::size_t i = 0; i < values.size(); ++i) {
+			offsets[i] = static_cast<std::uint64_t>(values[i]) - static_cast<std::uint64_t>(ref);
+			span |= offsets[i];
+		}
+		unsigned width = bit_width(span);
+		// Keep long constant runs decodable, see max_zero_width_count
+		if (width == 0 && values.size() > max_zero_width_count)
+			width = 1;
+		put_varint(out, values.size());
+		put_varint(out, zigzag(ref));
+		out.push_back(static_cast<char>(width));
+		pack(out, offsets.data(), offsets.size(), width);
+	}
+
+	std::vector<std::int64_t> for_decode(const std::string &str)
+	{
+		reader in(str);
+		std::uint64_t count = in.varint();
+		std::int64_t ref = unzigzag(in.varint());
+		unsigned width = in.byte();
+		if (width > 64 || (width != 0 && count > str.size() * 8 / width) || (width == 0 && count > max_zero_width_count))
+			throw cs::lang_error("Corrupted frame-of-reference data.");
+		std::size_t bytes = packed_bytes(count, width);
+		const unsigned char *data = in.take(bytes);
+		if (!in.done())
+			throw cs::lang_error("Corrupted frame-of-reference data.");
+		std::vector<std::uint64_t> offsets(count, 0);
+		if (width != 0)
+			unpack(data, bytes, offsets.data(), count, width);
+		std::vector<std::int64_t> values(count);
+		for (std::size_t i = 0; i < count; ++i)
+			values[i] = static_cast<std::int64_t>(static_cast<std::uint64_t>(ref) + offsets[i]);
+		return values;
+	}
+}
+
+// Non-cryptographic hashes: XXH3 (64/128), wyhash (final 4) and FNV-1a 64
+
+namespace bitwise_hash {
+	constexpr std::uint64_t prime32_1 = 0x9E3779B1U;
+	constexpr std::uint64_t prime32_2 = 0x85EBCA77U;
+	constexpr std::uint64_t prime32_3 = 0xC2B2AE3DU;
+	constexpr std::uint64_t prime64_1 = 0x9E3779B185EBCA87ULL;
+	constexpr std::uint64_t prime64_2 = 0xC2B2AE3D27D4EB4FULL;
+	constexpr std::uint64_t prime64_3 = 0x165667B19E3779F9ULL;
+	constexpr std::uint64_t prime64_4 = 0x85EBCA77C2B2AE63ULL;
+	constexpr std::uint64_t prime64_5 = 0x27D4EB2F165667C5ULL;
+
+	constexpr std::size_t stripe_len = 64;
+	constexpr std::size_t secret_consume_rate = 8;
+	constexpr std::size_t secret_size = 192;
+	constexpr std::size_t secret_size_min = 136;
+	constexpr std::size_t secret_mergeaccs_start = 11;
+	constexpr std::size_t secret_lastacc_start = 7;
+	constexpr std::size_t mid_size_max = 240;
+	constexpr std::size_t stripes_per_block = (secret_size - stripe_len) / secret_consume_rate;
+
+	alignas(64) constexpr unsigned char default_secret[secret_size] = {
+		0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+		0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+		0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+		0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+		0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+		0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+		0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+		0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+		0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+		0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+		0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+		0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+	};
+
+	struct hash128 {
+		std::uint64_t low, high;
+	};
+
+	std::uint32_t read32(const unsigned char *p) noexcept
+	{
+		return std::uint32_t(p[0]) | std::uint32_t(p[1]) << 8 | std::uint32_t(p[2]) << 16 | std::uint32_t(p[3]) << 24;
+	}
+
+	std::uint64_t read64(const unsigned char *p) noexcept
+	{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		std::uint64_t v;
+		std::memcpy(&v, p, sizeof(v));
+		return v;
+#else
+		return std::uint64_t(read32(p)) | std::uint64_t(read32(p + 4)) << 32;
+#endif
+	}
+
+	void write64(unsigned char *p, std::uint64_t v) noexcept
+	{
+		for (int i = 0; i < 8; ++i)
+			p[i] = static_cast<unsigned char>(v >> (8 * i));
+	}
+
+	std::uint64_t swap64(std::uint64_t v) noexcept
+	{
+#ifdef __GNUC__
+		return __builtin_bswap64(v);
+#else
+		v = ((v & 0x00FF00FF00FF00FFULL) << 8) | ((v >> 8) & 0x00FF00FF00FF00FFULL);
+		v = ((v & 0x0000FFFF0000FFFFULL) << 16) | ((v >> 16) & 0x0000FFFF0000FFFFULL);
+		return (v << 32) | (v >> 32);
+#endif
+	}
+
+	std::uint32_t swap32(std::uint32_t v) noexcept
+	{
+		return static_cast<std::uint32_t>(swap64(v) >> 32);
+	}
+
+	std::uint64_t rotl64(std::uint64_t v, unsigned r) noexcept
+	{
+		return (v << r) | (v >> (64 - r));
+	}
+
+	hash128 mul128(std::uint64_t lhs, std::uint64_t rhs) noexcept
+	{
+#ifdef __SIZEOF_INT128__
+		unsigned __int128 product = static_cast<unsigned __int128>(lhs) * rhs;
+		return {static_cast<std::uint64_t>(product), static_cast<std::uint64_t>(product >> 64)};
+#else
+		std::uint64_t lo_lo = (lhs & 0xFFFFFFFF) * (rhs & 0xFFFFFFFF);
+		std::uint64_t hi_lo = (lhs >> 32) * (rhs & 0xFFFFFFFF);
+		std::uint64_t lo_hi = (lhs & 0xFFFFFFFF) * (rhs >> 32);
+		std::uint64_t hi_hi = (lhs >> 32) * (rhs >> 32);
+		std::uint64_t cross = (lo_lo >> 32) + (hi_lo & 0xFFFFFFFF) + lo_hi;
+		return {(cross << 32) | (lo_lo & 0xFFFFFFFF), hi_hi + (hi_lo >> 32) + (cross >> 32)};
+#endif
+	}
+
+	std::uint64_t mul128_fold64(std::uint64_t lhs, std::uint64_t rhs) noexcept
+	{
+		hash128 product = mul128(lhs, rhs);
+		return product.low ^ product.high;
+	}
+
+	std::uint64_t xxh64_avalanche(std::uint64_t h) noexcept
+	{
+		h ^= h >> 33;
+		h *= prime64_2;
+		h ^= h >> 29;
+		h *= prime64_3;
+		return h ^ (h >> 32);
+	}
+
+	std::uint64_t xxh3_avalanche(std::uint64_t h) noexcept
+	{
+		h ^= h >> 37;
+		h *= 0x165667919E3779F9ULL;
+		return h ^ (h >> 32);
+	}
+
+	std::uint64_t rrmxmx(std::uint64_t h, std::uint64_t len) noexcept
+	{
+		h ^= rotl64(h, 49) ^ rotl64(h, 24);
+		h *= 0x9FB21C651E98DF25ULL;
+		h ^= (h >> 35) + len;
+		h *= 0x9FB21C651E98DF25ULL;
+		return h ^ (h >> 28);
+	}
+
+	std::uint64_t mix16(const unsigned char *input, const unsigned char *secret, std::uint64_t seed) noexcept
+	{
+		return mul128_fold64(read64(input) ^ (read64(secret) + seed), read64(input + 8) ^ (read64(secret + 8) - seed));
+	}
+
+	void mix32(hash128 &acc, const unsigned char *input_1, const unsigned char *input_2, const unsigned char *secret, std::uint64_t seed) noexcept
+	{
+		acc.low += mix16(input_1, secret, seed);
+		acc.low ^= read64(input_2) + read64(input_2 + 8);
+		acc.high += mix16(input_2, secret + 16, seed);
+		acc.high ^= read64(input_1) + read64(input_1 + 8);
+	}
+
+	// Long input kernels, one call covers nb_stripes consecutive stripes
+	using accumulate_kernel = void (*)(std::uint64_t *, const unsigned char *, const unsigned char *, std::size_t);
+	using scramble_kernel = void (*)(std::uint64_t *, const unsigned char *);
+
+	void accumulate_scalar(std::uint64_t *acc, const unsigned char *input, const unsigned char *secret, std::size_t nb_stripes)
+	{
+		for (std::size_t n = 0; n < nb_stripes; ++n, input += stripe_len, secret += secret_consume_rate) {
+			for (std::size_t i = 0; i < 8; ++i) {
+				std::uint64_t data_val = read64(input + 8 * i);
+				std::uint64_t data_key = data_val ^ read64(secret + 8 * i);
+				acc[i ^ 1] += data_val;
+				acc[i] += (data_key & 0xFFFFFFFF) * (data_key >> 32);
+			}
+		}
+	}
+
+	void scramble_scalar(std::uint64_t *acc, const unsigned char *secret)
+	{
+		for (std::size_t i = 0; i < 8; ++i) {
+			std::uint64_t v = acc[i];
+			v ^= v >> 47;
+			v ^= read64(secret + 8 * i);
+			acc[i] = v * prime32_1;
+		}
+	}
+
+#ifdef BITWISE_X86_DISPATCH
+	__attribute__((target("avx2"))) void accumulate_avx2(std::uint64_t *acc, const unsigned char *input, const unsigned char *secret, std::size_t nb_stripes)
+	{
+		__m256i acc_lo = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(acc));
+		__m256i acc_hi = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(acc + 4));
+		for (std::size_t n = 0; n < nb_stripes; ++n, input += stripe_len, secret += secret_consume_rate) {
+			__m256i data_lo = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(input));
+			__m256i data_hi = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(input + 32));
+			__m256i key_lo = _mm256_xor_si256(data_lo, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(secret)));
+			__m256i key_hi = _mm256_xor_si256(data_hi, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(secret + 32)));
+			__m256i prod_lo = _mm256_mul_epu32(key_lo, _mm256_srli_epi64(key_lo, 32));
+			__m256i prod_hi = _mm256_mul_epu32(key_hi, _mm256_srli_epi64(key_hi, 32));
+			acc_lo = _mm256_add_epi64(acc_lo, _mm256_add_epi64(prod_lo, _mm256_shuffle_epi32(data_lo, 0x4E)));
+			acc_hi = _mm256_add_epi64(acc_hi, _mm256_add_epi64(prod_hi, _mm256_shuffle_epi32(data_hi, 0x4E)));
+		}
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(acc), acc_lo);
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(acc + 4), acc_hi);
+	}
+
+	__attribute__((target("avx2"))) void scramble_avx2(std::uint64_t *acc, const unsigned char *secret)
+	{
+		const __m256i prime = _mm256_set1_epi32(static_cast<int>(prime32_1));
+		for (std::size_t i = 0; i < 2; ++i) {
+			__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(acc + 4 * i));
+			v = _mm256_xor_si256(v, _mm256_srli_epi64(v, 47));
+			v = _mm256_xor_si256(v, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(secret + 32 * i)));
+			__m256i prod_lo = _mm256_mul_epu32(v, prime);
+			__m256i prod_hi = _mm256_mul_epu32(_mm256_srli_epi64(v, 32), prime);
+			_mm256_storeu_si256(reinterpret_cast<__m256i *>(acc + 4 * i), _mm256_add_epi64(prod_lo, _mm256_slli_epi64(prod_hi, 32)));
+		}
+	}
+
+	accumulate_kernel select_accumulate() noexcept
+	{
+		return bitwise_kernels::has_avx2() ? &accumulate_avx2 : &accumulate_scalar;
+	}
+
+	scramble_kernel select_scramble() noexcept
+	{
+		return bitwise_kernels::has_avx2() ? &scramble_avx2 : &scramble_scalar;
+	}
+#else
+	accumulate_kernel select_accumulate() noexcept
+	{
+		return &accumulate_scalar;
+	}
+
+	scramble_kernel select_scramble() noexcept
+	{
+		return &scramble_scalar;
+	}
+#endif
+
+	const accumulate_kernel accumulate = select_accumulate();
+	const scramble_kernel scramble = select_scramble();
+
+	struct xxh3_acc {
+		std::uint64_t v[8] = {prime32_3, prime64_1, prime64_2, prime64_3, prime64_4, prime32_2, prime64_5, prime32_1};
+	};
+
+	void derive_secret(unsigned char *secret, std::uint64_t seed) noexcept
+	{
+		for (std::size_t i = 0; i < secret_size; i += 16) {
+			write64(secret + i, read64(default_secret + i) + seed);
+			write64(secret + i + 8, read64(default_secret + i + 8) - seed);
+		}
+	}
+
+	std::uint64_t merge_accs(const xxh3_acc &acc, const unsigned char *secret, std::uint64_t start) noexcept
+	{
+		for (std::size_t i = 0; i < 4; ++i)
+			start += mul128_fold64(acc.v[2 * i] ^ read64(secret + 16 * i), acc.v[2 * i + 1] ^ read64(secret + 16 * i + 8));
+		return xxh3_avalanche(start);
+	}
+
+	void hash_long_loop(xxh3_acc &acc, const unsigned char *input, std::size_t len, const unsigned char *secret) noexcept
+	{
+		const std::size_t block_len = stripe_len * stripes_per_block;
+		const std::size_t nb_blocks = (len - 1) / block_len;
+		for (std::size_t n = 0; n < nb_blocks; ++n) {
+			accumulate(acc.v, input + n * block_len, secret, stripes_per_block);
+			scramble(acc.v, secret + secret_size - stripe_len);
+		}
+		const std::size_t nb_stripes = ((len - 1) - block_len * nb_blocks) / stripe_len;
+		accumulate(acc.v, input + nb_blocks * block_len, secret, nb_stripes);
+		accumulate(acc.v, input + len - stripe_len, secret + secret_size - stripe_len - secret_lastacc_start, 1);
+	}
+
+	std::uint64_t xxh3_64_short(const unsigned char *input, std::size_t len, std::uint64_t seed, const unsigned char *secret) noexcept
+	{
+		if (len > 8) {
+			std::uint64_t flip1 = (read64(secret + 24) ^ read64(secret + 32)) + seed;
+			std::uint64_t flip2 = (read64(secret + 40) ^ read64(secret + 48)) - seed;
+			std::uint64_t lo = read64(input) ^ flip1, hi = read64(input + len - 8) ^ flip2;
+			return xxh3_avalanche(len + swap64(lo) + hi + mul128_fold64(lo, hi));
+		}
+		if (len >= 4) {
+			seed ^= std::uint64_t(swap32(static_cast<std::uint32_t>(seed))) << 32;
+			std::uint64_t flip = (read64(secret + 8) ^ read64(secret + 16)) - seed;
+			std::uint64_t input64 = read32(input + len - 4) + (std::uint64_t(read32(input)) << 32);
+			return rrmxmx(input64 ^ flip, len);
+		}
+		if (len > 0) {
+			std::uint32_t combo = std::uint32_t(input[0]) << 16 | std::uint32_t(input[len >> 1]) << 24 | input[len - 1] | std::uint32_t(len) << 8;
+			std::uint64_t flip = (read32(secret) ^ read32(secret + 4)) + seed;
+			return xxh64_avalanche(combo ^ flip);
+		}
+		return xxh64_avalanche(seed ^ read64(secret + 56) ^ read64(secret + 64));
+	}
+
+	std::uint64_t xxh3_64_mid(const unsigned char *input, std::size_t len, std::uint64_t seed, const unsigned char *secret) noexcept
+	{
+		std::uint64_t acc = len * prime64_1;
+		if (len <= 128) {
+			if (len > 32) {
+				if (len > 64) {
+					if (len > 96) {
+						acc += mix16(input + 48, secret + 96, seed);
+						acc += mix16(input + len - 64, secret + 112, seed);
+					}
+					acc += mix16(input + 32, secret + 64, seed);
+					acc += mix16(input + len - 48, secret + 80, seed);
+				}
+				acc += mix16(input + 16, secret + 32, seed);
+				acc += mix16(input + len - 32, secret + 48, seed);
+			}
+			acc += mix16(input, secret, seed);
+			acc += mix16(input + len - 16, secret + 16, seed);
+			return xxh3_avalanche(acc);
+		}
+		const std::size_t nb_rounds = len / 16;
+		for (std::size_t i = 0; i < 8; ++i)
+			acc += mix16(input + 16 * i, secret + 16 * i, seed);
+		acc = xxh3_avalanche(acc);
+		for (std::size_t i = 8; i < nb_rounds; ++i)
+			acc += mix16(input + 16 * i, secret + 16 * (i - 8) + 3, seed);
+		acc += mix16(input + len - 16, secret + secret_size_min - 17, seed);
+		return xxh3_avalanche(acc);
+	}
+
+	hash128 xxh3_128_short(const unsigned char *input, std::size_t len, std::uint64_t seed, const unsigned char *secret) noexcept
+	{
+		if (len > 8) {
+			std::uint64_t flip_lo = (read64(secret + 32) ^ read64(secret + 40)) - seed;
+			std::uint64_t flip_hi = (read64(secret + 48) ^ read64(secret + 56)) + seed;
+			std::uint64_t input_lo = read64(input), input_hi = read64(input + len - 8);
+			hash128 m = mul128(input_lo ^ input_hi ^ flip_lo, prime64_1);
+			m.low += std::uint64_t(len - 1) << 54;
+			input_hi ^= flip_hi;
+			m.high += input_hi + (input_hi & 0xFFFFFFFF) * (prime32_2 - 1);
+			m.low ^= swap64(m.high);
+			hash128 h = mul128(m.low, prime64_2);
+			h.high += m.high * prime64_2;
+			return {xxh3_avalanche(h.low), xxh3_avalanche(h.high)};
+		}
+		if (len >= 4) {
+			seed ^= std::uint64_t(swap32(static_cast<std::uint32_t>(seed))) << 32;
+			std::uint64_t input64 = read32(input) + (std::uint64_t(read32(input + len - 4)) << 32);
+			std::uint64_t flip = (read64(secret + 16) ^ read64(secret + 24)) + seed;
+			hash128 m = mul128(input64 ^ flip, prime64_1 + (std::uint64_t(len) << 2));
+			m.high += m.low << 1;
+			m.low ^= m.high >> 3;
+			m.low ^= m.low >> 35;
+			m.low *= 0x9FB21C651E98DF25ULL;
+			m.low ^= m.low >> 28;
+			return {m.low, xxh3_avalanche(m.high)};
+		}
+		if (len > 0) {
+			std::uint32_t combo_lo = std::uint32_t(input[0]) << 16 | std::uint32_t(input[len >> 1]) << 24 | input[len - 1] | std::uint32_t(len) << 8;
+			std::uint32_t swapped = swap32(combo_lo);
+			std::uint32_t combo_hi = (swapped << 13) | (swapped >> 19);
+			std::uint64_t flip_lo = (std::uint64_t(read32(secret)) ^ read32(secret + 4)) + seed;
+			std::uint64_t flip_hi = (std::uint64_t(read32(secret + 8)) ^ read32(secret + 12)) - seed;
+			return {xxh64_avalanche(combo_lo ^ flip_lo), xxh64_avalanche(combo_hi ^ flip_hi)};
+		}
+		return {xxh64_avalanche(seed ^ read64(secret + 64) ^ read64(secret + 72)), xxh64_avalanche(seed ^ read64(secret + 80) ^ read64(secret + 88))};
+	}
+
+	hash128 xxh3_128_mid(const unsigned char *input, std::size_t len, std::uint64_t seed, const unsigned char *secret) noexcept
+	{
+		hash128 acc = {len * prime64_1, 0};
+		if (len <= 128) {
+			if (len > 32) {
+				if (len > 64) {
+					if (len > 96)
+						mix32(acc, input + 48, input + len - 64, secret + 96, seed);
+					mix32(acc, input + 32, input + len - 48, secret + 64, seed);
+				}
+				mix32(acc, input + 16, input + len - 32, secret + 32, seed);
+			}
+			mix32(acc, input, input + len - 16, secret, seed);
+		}
+		else {
+			const std::size_t nb_rounds = len / 32;
+			for (std::size_t i = 0; i < 4; ++i)
+				mix32(acc, input + 32 * i, input + 32 * i + 16, secret + 32 * i, seed);
+			acc.low = xxh3_avalanche(acc.low);
+			acc.high = xxh3_avalanche(acc.high);
+			for (std::size_t i = 4; i < nb_rounds; ++i)
+				mix32(acc, input + 32 * i, input + 32 * i + 16, secret + 3 + 32 * (i - 4), seed);
+			mix32(acc, input + len - 16, input + len - 32, secret + secret_size_min - 17 - 16, 0 - seed);
+		}
+		return {xxh3_avalanche(acc.low + acc.high),
+		        0 - xxh3_avalanche(acc.low * prime64_1 + acc.high * prime64_4 + (len - seed) * prime64_2)};
+	}
+
+	std::uint64_t xxh3_64(const unsigned char *input, std::size_t len, std::uint64_t seed)
+	{
+		if (len <= 16)
+			return xxh3_64_short(input, len, seed, default_secret);
+		if (len <= mid_size_max)
+			return xxh3_64_mid(input, len, seed, default_secret);
+		alignas(64) unsigned char custom[secret_size];
+		const unsigned char *secret = default_secret;
+		if (seed != 0) {
+			derive_secret(custom, seed);
+			secret = custom;
+		}
+		xxh3_acc acc;
+		hash_long_loop(acc, input, len, secret);
+		return merge_accs(acc, secret + secret_mergeaccs_start, len * prime64_1);
+	}
+
+	hash128 xxh3_128(const unsigned char *input, std::size_t len, std::uint64_t seed)
+	{
+		if (len <= 16)
+			return xxh3_128_short(input, len, seed, default_secret);
+		if (len <= mid_size_max)
+			return xxh3_128_mid(input, len, seed, default_secret);
+		alignas(64) unsigned char custom[secret_size];
+		const unsigned char *secret = default_secret;
+		if (seed != 0) {
+			derive_secret(custom, seed);
+			secret = custom;
+		}
+		xxh3_acc acc;
+		hash_long_loop(acc, input, len, secret);
+		return {merge_accs(acc, secret + secret_mergeaccs_start, len * prime64_1),
+		        merge_accs(acc, secret + secret_size - sizeof(acc.v) - secret_mergeaccs_start, ~(len * prime64_2))};
+	}
+
+	// Streaming XXH3, digests match the one-shot functions
+	class xxh3_state final {
+		static constexpr std::size_t buffer_size = 256;
+		xxh3_acc acc;
+		alignas(64) unsigned char secret[secret_size];
+		alignas(64) unsigned char buffer[buffer_size];
+		std::size_t buffered = 0, nb_stripes_acc = 0;
+		std::uint64_t total_len = 0, seed = 0;
+
+		std::size_t consume_stripes(xxh3_acc &target, std::size_t nb_stripes, std::size_t stripes_acc, const unsigned char *input) const
+		{
+			if (stripes_per_block - stripes_acc <= nb_stripes) {
+				std::size_t to_end = stripes_per_block - stripes_acc, after_end = nb_stripes - to_end;
+				accumulate(target.v, input, secret + stripes_acc * secret_consume_rate, to_end);
+				scramble(target.v, secret + secret_size - stripe_len);
+				accumulate(target.v, input + to_end * stripe_len, secret, after_end);
+				return after_end;
+			}
+			accumulate(target.v, input, secret + stripes_acc * secret_consume_rate, nb_stripes);
+			return stripes_acc + nb_stripes;
+		}
+		void digest_long(xxh3_acc &target) const
+		{
+			if (buffered >= stripe_len) {
+				std::size_t nb_stripes = (buffered - 1) / stripe_len;
+				consume_stripes(target, nb_stripes, nb_stripes_acc, buffer);
+				accumulate(target.v, buffer + buffered - stripe_len, secret + secret_size - stripe_len - secret_lastacc_start, 1);
+			}
+			else {
+				// Complete the last stripe with bytes from the previous buffer fill
+				unsigned char last_stripe[stripe_len];
+				std::size_t catchup = stripe_len - buffered;
+				std::memcpy(last_stripe, buffer + buffer_size - catchup, catchup);
+				std::memcpy(last_stripe + catchup, buffer, buffered);
+				accumulate(target.v, last_stripe, secret + secret_size - stripe_len - secret_lastacc_start, 1);
+			}
+		}
+	public:
+		explicit xxh3_state(std::uint64_t s = 0)
+		{
+			reset(s);
+		}
+		void reset(std::uint64_t s)
+		{
+			acc = xxh3_acc();
+			buffered = nb_stripes_acc = 0;
+			total_len = 0;
+			seed = s;
+			if (seed == 0)
+				std::memcpy(secret, default_secret, secret_size);
+			else
+				derive_secret(secret, seed);
+		}
+		void reset()
+		{
+			acc = xxh3_acc();
+			buffered = nb_stripes_acc = 0;
+			total_len = 0;
+		}
+		void update(const unsigned char *input, std::size_t len)
+		{
+			total_len += len;
+			if (buffered + len <= buffer_size) {
+				std::memcpy(buffer + buffered, input, len);
+				buffered += len;
+				return;
+			}
+			if (buffered > 0) {
+				std::size_t fill = buffer_size - buffered;
+				std::memcpy(buffer + buffered, input, fill);
+				input += fill;
+				len -= fill;
+				nb_stripes_acc = consume_stripes(acc, buffer_size / stripe_len, nb_stripes_acc, buffer);
+				buffered = 0;
+			}
+			if (len > buffer_size) {
+				do {
+					nb_stripes_acc = consume_stripes(acc, buffer_size / stripe_len, nb_stripes_acc, input);
+					input += buffer_size;
+					len -= buffer_size;
+				}
+				while (len > buffer_size);
+				// Keep the last full stripe for digests of a short tail
+				std::memcpy(buffer + buffer_size - stripe_len, input - stripe_len, stripe_len);
+			}
+			std::memcpy(buffer, input, len);
+			buffered = len;
+		}
+		std::uint64_t digest() const
+		{
+			if (total_len <= mid_size_max)
+				return xxh3_64(buffer, static_cast<std::size_t>(total_len), seed);
+			xxh3_acc target = acc;
+			digest_long(target);
+			return merge_accs(target, secret + secret_mergeaccs_start, total_len * prime64_1);
+		}
+		hash128 digest128() const
+		{
+			if (total_len <= mid_size_max)
+				return xxh3_128(buffer, static_cast<std::size_t>(total_len), seed);
+			xxh3_acc target = acc;
+			digest_long(target);
+			return {merge_accs(target, secret + secret_mergeaccs_start, total_len * prime64_1),
+			        merge_accs(target, secret + secret_size - sizeof(target.v) - secret_mergeaccs_start, ~(total_len * prime64_2))};
+		}
+	};
+
+	constexpr std::uint64_t wyp[4] = {0x2d358dccaa6c78a5ULL, 0x8bb84b93962eacc9ULL, 0x4b33a62ed433d4a3ULL, 0x4d5a2da51de1aa47ULL};
+
+	std::uint64_t wymix(std::uint64_t a, std::uint64_t b) noexcept
+	{
+		return mul128_fold64(a, b);
+	}
+
+	std::uint64_t wyhash(const unsigned char *p, std::size_t len, std::uint64_t seed) noexcept
+	{
+		seed ^= wymix(seed ^ wyp[0], wyp[1]);
+		std::uint64_t a, b;
+		if (len <= 16) {
+			if (len >= 4) {
+				a = (std::uint64_t(read32(p)) << 32) | read32(p + ((len >> 3) << 2));
+				b = (std::uint64_t(read32(p + len - 4)) << 32) | read32(p + len - 4 - ((len >> 3) << 2));
+			}
+			else if (len > 0) {
+				a = (std::uint64_t(p[0]) << 16) | (std::uint64_t(p[len >> 1]) << 8) | p[len - 1];
+				b = 0;
+			}
+			else
+				a = b = 0;
+		}
+		else {
+			std::size_t i = len;
+			if (i >= 48) {
+				std::uint64_t see1 = seed, see2 = seed;
+				do {
+					seed = wymix(read64(p) ^ wyp[1], read64(p + 8) ^ seed);
+					see1 = wymix(read64(p + 16) ^ wyp[2], read64(p + 24) ^ see1);
+					see2 = wymix(read64(p + 32) ^ wyp[3], read64(p + 40) ^ see2);
+					p += 48;
+					i -= 48;
+				}
+				while (i >= 48);
+				seed ^= see1 ^ see2;
+			}
+			while (i > 16) {
+				seed = wymix(read64(p) ^ wyp[1], read64(p + 8) ^ seed);
+				i -= 16;
+				p += 16;
+			}
+			a = read64(p + i - 16);
+			b = read64(p + i - 8);
+		}
+		hash128 m = mul128(a ^ wyp[1], b ^ seed);
+		return wymix(m.low ^ wyp[0] ^ len, m.high ^ wyp[1]);
+	}
+
+	constexpr std::uint64_t fnv_offset_basis = 0xcbf29ce484222325ULL;
+	constexpr std::uint64_t fnv_prime = 0x100000001b3ULL;
+
+	// A seed is mixed into the offset basis, seed 0 is standard FNV-1a
+	std::uint64_t fnv1a(std::uint64_t state, const unsigned char *p, std::size_t len) noexcept
+	{
+		for (std::size_t i = 0; i < len; ++i)
+			state = (state ^ p[i]) * fnv_prime;
+		return state;
+	}
+
+	const unsigned char *bytes(const std::string &str) noexcept
+	{
+		return reinterpret_cast<const unsigned char *>(str.data());
+	}
+
+	cs::var to_pair(const hash128 &h)
+	{
+		cs::var ret = cs::var::make<cs::array>();
+		cs::array &arr = ret.val<cs::array>();
+		arr.emplace_back(cs::var::make<bitset_t>(h.low));
+		arr.emplace_back(cs::var::make<bitset_t>(h.high));
+		return ret;
+	}
+}
+
+// Incremental hasher over XXH3 or FNV-1a
+
+class hasher_t final {
+public:
+	enum class algorithm {
+		xxh3, fnv1a
+	};
+private:
+	algorithm algo = algorithm::xxh3;
+	std::uint64_t seed = 0, fnv_state = bitwise_hash::fnv_offset_basis;
+	bitwise_hash::xxh3_state xxh3;
+public:
+	hasher_t() = default;
+	hasher_t(algorithm a, std::uint64_t s) : algo(a), seed(s), fnv_state(bitwise_hash::fnv_offset_basis ^ s), xxh3(s) {}
+	void update(const std::string &data)
+	{
+		if (algo == algorithm::xxh3)
+			xxh3.update(bitwise_hash::bytes(data), data.size());
+		else
+			fnv_state = bitwise_hash::fnv1a(fnv_state, bitwise_hash::bytes(data), data.size());
+	}
+	std::uint64_t digest() const
+	{
+		return algo == algorithm::xxh3 ? xxh3.digest() : fnv_state;
+	}
+	bitwise_hash::hash128 digest128() const
+	{
+		if (algo != algorithm::xxh3)
+			throw cs::lang_error("128-bit digest is only available for XXH3.");
+		return xxh3.digest128();
+	}
+	void reset()
+	{
+		if (algo == algorithm::xxh3)
+			xxh3.reset();
+		else
+			fnv_state = bitwise_hash::fnv_offset_basis ^ seed;
+	}
+};
+
+// Probabilistic sketches keyed by XXH3 of the key bytes
+
+namespace bitwise_sketch {
+	std::uint64_t key_hash(const cs::var &key)
+	{
+		unsigned char buff[8];
+		if (key.type() == typeid(cs::string)) {
+			const cs::string &str = key.const_val<cs::string>();
+			return bitwise_hash::xxh3_64(bitwise_hash::bytes(str), str.size(), 0);
+		}
+		if (key.type() == typeid(cs::numeric)) {
+			const cs::numeric &num = key.const_val<cs::numeric>();
+			if (num.is_integer())
+				bitwise_hash::write64(buff, static_cast<std::uint64_t>(num.as_integer()));
+			else {
+				double val = static_cast<double>(num.as_float());
+				std::uint64_t bits;
+				std::memcpy(&bits, &val, sizeof(bits));
+				bitwise_hash::write64(buff, bits);
+			}
+		}
+		else if (key.type() == typeid(bitset_t))
+			bitwise_hash::write64(buff, key.const_val<bitset_t>().to_ullong());
+		else
+			throw cs::lang_error("Sketch keys must be strings, numbers or bitsets.");
+		return bitwise_hash::xxh3_64(buff, sizeof(buff), 0);
+	}
+
+	// Maps a hash onto [0, n) without division
+	std::uint64_t fast_range(std::uint64_t hash, std::uint64_t n) noexcept
+	{
+		return bitwise_hash::mul128(hash, n).high;
+	}
+
+	void prefetch(const void *addr) noexcept
+	{
+#ifdef __GNUC__
+		__builtin_prefetch(addr);
+#else
+		(void)addr;
+#endif
+	}
+
+	class writer {
+		std::string &out;
+	public:
+		explicit writer(std::string &str) : out(str) {}
+		void u64(std::uint64_t v)
+		{
+			unsigned char buff[8];
+			bitwise_hash::write64(buff, v);
+			out.append(reinterpret_cast<const char *>(buff), 8);
+		}
+		void raw(const void *data, std::size_t size)
+		{
+			out.append(static_cast<const char *>(data), size);
+		}
+	};
+
+	class reader {
+		const unsigned char *ptr, *end;
+	public:
+		reader(const std::string &str, const char *magic) : ptr(bitwise_hash::bytes(str)), end(ptr + str.size())
+		{
+			if (str.compare(0, 4, magic) != 0)
+				throw cs::lang_error("Unrecognized sketch data.");
+			ptr += 4;
+		}
+		const unsigned char *take(std::size_t n)
+		{
+			if (static_cast<std::size_t>(end - ptr) < n)
+				throw cs::lang_error("Truncated sketch data.");
+			const unsigned char *ret = ptr;
+			ptr += n;
+			return ret;
+		}
+		std::uint64_t u64()
+		{
+			return bitwise_hash::read64(take(8));
+		}
+		void finish() const
+		{
+			if (ptr != end)
+				throw cs::lang_error("Corrupted sketch data.");
+		}
+	};
+
+	// Blocked Bloom filter, every key lives in a single 512-bit cache line
+	class bloom_filter final {
+		struct alignas(64) block {
+			std::uint64_t words[8] = {};
+		};
+		std::vector<block> blocks;
+		std::uint64_t hashes = 0;
+
+		block &block_of(std::uint64_t hash) noexcept
+		{
+			return blocks[fast_range(hash, blocks.size())];
+		}
+		const block &block_of(std::uint64_t hash) const noexcept
+		{
+			return blocks[fast_range(hash, blocks.size())];
+		}
+		// Each probe takes its own 9 bits from remixes of the key hash; double
+		// hashing inside 512 bits yields too few distinct patterns
+		template<typename FuncT>
+		void for_each_bit(std::uint64_t hash, FuncT &&func) const
+		{
+			std::uint64_t bits = 0;
+			for (std::uint64_t i = 0; i < hashes; ++i) {
+				if (i % 7 == 0)
+					bits = bitwise_hash::rrmxmx(hash, i / 7);
+				std::uint32_t bit = static_cast<std::uint32_t>(bits & 511);
+				bits >>= 9;
+				func(bit / 64, std::uint64_t(1) << (bit % 64));
+			}
+		}
+	public:
+		bloom_filter(std::uint64_t block_count, std::uint64_t hash_count) : blocks(block_count), hashes(hash_count) {}
+		// False positive rate of the blocked layout: keys per block follow a
+		// Poisson distribution and each block is a 512-bit classic filter
+		static double blocked_fpp(double expected, std::uint64_t block_count, std::uint64_t hash_count)
+		{
+			const double lambda = expected / static_cast<double>(block_count);
+			const double keep = std::log1p(-1.0 / 512) * static_cast<double>(hash_count);
+			const std::uint64_t limit = static_cast<std::uint64_t>(lambda + 10 * std::sqrt(lambda) + 10);
+			double prob = std::exp(-lambda), sum = 0;
+			for (std::uint64_t i = 0; i <= limit; ++i) {
+				sum += prob * std::pow(1 - std::exp(keep * static_cast<double>(i)), static_cast<double>(hash_count));
+				prob *= lambda / static_cast<double>(i + 1);
+			}
+			return sum;
+		}
+		// Classic sizing undershoots for blocked filters (uneven block load),
+		// so the block count grows until the blocked estimate meets the target
+		static std::shared_ptr<bloom_filter> create(double expected, double fpp)
+		{
+			if (!(expected >= 1) || !(fpp > 0 && fpp < 1))
+				throw cs::lang_error("Bloom filter needs expected items >= 1 and 0 < fpp < 1.");
+			const double ln2 = std::log(2.0);
+			double bits = std::ceil(-expected * std::log(fpp) / (ln2 * ln2));
+			std::uint64_t block_count = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(std::ceil(bits / 512)));
+			std::uint64_t hash_count = static_cast<std::uint64_t>(std::round(bits / expected * ln2));
+			hash_count = std::min<std::uint64_t>(16, std::max<std::uint64_t>(1, hash_count));
+			for (int i = 0; i < 64 && blocked_fpp(expected, block_count, hash_count) > fpp; ++i)
+				block_count += std::max<std::uint64_t>(1, block_count / 32);
+			return std::make_shared<bloom_filter>(block_count, hash_count);
+		}
+		void add(std::uint64_t hash) noexcept
+		{
+			block &b = block_of(hash);
+			for_each_bit(hash, [&b](std::size_t word, std::uint64_t mask) {
+				b.words[word] |= mask;
+			});
+		}
+		bool contains(std::uint64_t hash) const noexcept
+		{
+			const block &b = block_of(hash);
+			bool found = true;
+			for_each_bit(hash, [&b, &found](std::size_t word, std::uint64_t mask) {
+				found &= (b.words[word] & mask) != 0;
+			});
+			return found;
+		}
+		void prefetch_for(std::uint64_t hash) const noexcept
+		{
+			prefetch(&block_of(hash));
+		}
+		void merge(const bloom_filter &other)
+		{
+			if (blocks.size() != other.blocks.size() || hashes != other.hashes)
+				throw cs::lang_error("Merging Bloom filters with different parameters.");
+			bitwise_kernels::bitwise_or(blocks.data()->words, blocks.data()->words, other.blocks.data()->words, blocks.size() * 8);
+		}
+		void clear() noexcept
+		{
+			std::fill(blocks.begin(), blocks.end(), block());
+		}
+		std::uint64_t bit_count() const noexcept
+		{
+			return blocks.size() * 512;
+		}
+		std::uint64_t hash_count() const noexcept
+		{
+			return hashes;
+		}
+		std::string serialize() const
+		{
+			std::string out("BLM1");
+			writer w(out);
+			w.u64(blocks.size());
+			w.u64(hashes);
+			for (auto &b : blocks)
+				for (auto word : b.words)
+					w.u64(word);
+			return out;
+		}
+		static std::shared_ptr<bloom_filter> deserialize(const std::string &data)
+		{
+			reader in(data, "BLM1");
+			std::uint64_t block_count = in.u64(), hash_count = in.u64();
+			if (block_count == 0 || hash_count == 0 || hash_count > 16 || block_count > data.size() / 64)
+				throw cs::lang_error("Corrupted sketch data.");
+			auto ret = std::make_shared<bloom_filter>(block_count, hash_count);
+			for (auto &b : ret->blocks)
+				for (auto &word : b.words)
+					word = in.u64();
+			in.finish();
+			return ret;
+		}
+	};
+
+	// Count-min sketch with saturating 32-bit counters
+	class count_min final {
+		std::uint64_t width, depth;
+		std::vector<std::uint32_t> table;
+
+		std::uint64_t index_of(std::uint64_t hash, std::uint64_t row) const noexcept
+		{
+			std::uint64_t h2 = bitwise_hash::rrmxmx(hash, row) | 1;
+			return row * width + fast_range(hash + row * h2, width);
+		}
+	public:
+		count_min(std::uint64_t w, std::uint64_t d) : width(w), depth(d), table(w * d, 0) {}
+		static std::shared_ptr<count_min> create(double epsilon, double delta)
+		{
+			if (!(epsilon > 0 && epsilon < 1) || !(delta > 0 && delta < 1))
+				throw cs::lang_error("Count-min sketch needs 0 < epsilon < 1 and 0 < delta < 1.");
+			std::uint64_t w = static_cast<std::uint64_t>(std::ceil(std::exp(1.0) / epsilon));
+			std::uint64_t d = static_cast<std::uint64_t>(std::ceil(std::log(1 / delta)));
+			return std::make_shared<count_min>(w, std::max<std::uint64_t>(1, d));
+		}
+		void add(std::uint64_t hash, std::uint64_t count) noexcept
+		{
+			for (std::uint64_t row = 0; row < depth; ++row) {
+				std::uint32_t &cell = table[index_of(hash, row)];
+				cell = static_cast<std::uint32_t>(std::min<std::uint64_t>(std::uint64_t(cell) + count, 0xFFFFFFFF));
+			}
+		}
+		std::uint64_t estimate(std::uint64_t hash) const noexcept
+		{
+			std::uint32_t ret = 0xFFFFFFFF;
+			for (std::uint64_t row = 0; row < depth; ++row)
+				ret = std::min(ret, table[index_of(hash, row)]);
+			return ret;
+		}
+		void prefetch_for(std::uint64_t hash) const noexcept
+		{
+			for (std::uint64_t row = 0; row < depth; ++row)
+				prefetch(&table[index_of(hash, row)]);
+		}
+		void merge(const count_min &other)
+		{
+			if (width != other.width || depth != other.depth)
+				throw cs::lang_error("Merging count-min sketches with different parameters.");
+			for (std::size_t i = 0; i < table.size(); ++i)
+				table[i] = static_cast<std::uint32_t>(std::min<std::uint64_t>(std::uint64_t(table[i]) + other.table[i], 0xFFFFFFFF));
+		}
+		void clear() noexcept
+		{
+			std::fill(table.begin(), table.end(), 0);
+		}
+		std::uint64_t get_width() const noexcept
+		{
+			return width;
+		}
+		std::uint64_t get_depth() const noexcept
+		{
+			return depth;
+		}
+		std::string serialize() const
+		{
+			std::string out("CMS1");
+			writer w(out);
+			w.u64(width);
+			w.u64(depth);
+			for (auto cell : table) {
+				unsigned char buff[4] = {static_cast<unsigned char>(cell), static_cast<unsigned char>(cell >> 8), static_cast<unsigned char>(cell >> 16), static_cast<unsigned char>(cell >> 24)};
+				w.raw(buff, 4);
+			}
+			return out;
+		}
+		static std::shared_ptr<count_min> deserialize(const std::string &data)
+		{
+			reader in(data, "CMS1");
+			std::uint64_t w = in.u64(), d = in.u64();
+			if (w == 0 || d == 0 || w > data.size() / 4 || d > data.size() / 4 / w)
+				throw cs::lang_error("Corrupted sketch data.");
+			auto ret = std::make_shared<count_min>(w, d);
+			const unsigned char *cells = in.take(ret->table.size() * 4);
+			for (std::size_t i = 0; i < ret->table.size(); ++i)
+				ret->table[i] = bitwise_hash::read32(cells + 4 * i);
+			in.finish();
+			return ret;
+		}
+	};
+
+	// HyperLogLog with 2^precision 8-bit registers and linear counting for
+	// small cardinalities, the 64-bit hash makes large range correction moot
+	class hyperloglog final {
+		unsigned precision;
+		std::vector<std::uint8_t> registers;
+	public:
+		explicit hyperloglog(unsigned p) : precision(p), registers(std::size_t(1) << p, 0)
+		{
+			if (p < 4 || p > 18)
+				throw cs::lang_error("HyperLogLog precision must be in [4, 18].");
+		}
+		void add(std::uint64_t hash) noexcept
+		{
+			std::size_t idx = hash >> (64 - precision);
+			std::uint64_t rest = (hash << precision) | (std::uint64_t(1) << (precision - 1));
+			std::uint8_t rank = static_cast<std::uint8_t>(bitwise_kernels::clz_word(rest) + 1);
+			registers[idx] = std::max(registers[idx], rank);
+		}
+		double estimate() const noexcept
+		{
+			const double m = static_cast<double>(registers.size());
+			double sum = 0;
+			std::size_t zeros = 0;
+			for (auto r : registers) {
+				sum += std::ldexp(1.0, -r);
+				zeros += r == 0;
+			}
+			double alpha = registers.size() == 16 ? 0.673 : registers.size() == 32 ? 0.697 : registers.size() == 64 ? 0.709 : 0.7213 / (1 + 1.079 / m);
+			double raw = alpha * m * m / sum;
+			if (raw <= 2.5 * m && zeros != 0)
+				return m * std::log(m / static_cast<double>(zeros));
+			return raw;
+		}
+		void merge(const hyperloglog &other)
+		{
+			if (precision != other.precision)
+				throw cs::lang_error("Merging HyperLogLog sketches with different precision.");
+			for (std::size_t i = 0; i < registers.size(); ++i)
+				registers[i] = std::max(registers[i], other.registers[i]);
+		}
+		void clear() noexcept
+		{
+			std::fill(registers.begin(), registers.end(), 0);
+		}
+		unsigned get_precision() const noexcept
+		{
+			return precision;
+		}
+		std::string serialize() const
+		{
+			std::string out("HLL1");
+			writer w(out);
+			w.u64(precision);
+			w.raw(registers.data(), registers.size());
+			return out;
+		}
+		static std::shared_ptr<hyperloglog> deserialize(const std::string &data)
+		{
+			reader in(data, "HLL1");
+			std::uint64_t p = in.u64();
+			if (p < 4 || p > 18)
+				throw cs::lang_error("Corrupted sketch data.");
+			auto ret = std::make_shared<hyperloglog>(static_cast<unsigned>(p));
+			const unsigned char *regs = in.take(ret->registers.size());
+			for (std::size_t i = 0; i < ret->registers.size(); ++i) {
+				if (regs[i] > 64 - p + 1)
+					throw cs::lang_error("Corrupted sketch data.");
+				ret->registers[i] = regs[i];
+			}
+			in.finish();
+			return ret;
+		}
+	};
+
+	// Hashes a batch up front so lookups can be prefetched a few keys ahead
+	constexpr std::size_t prefetch_distance = 8;
+
+	std::vector<std::uint64_t> hash_all(const cs::array &keys)
+	{
+		std::vector<std::uint64_t> hashes;
+		hashes.reserve(keys.size());
+		for (auto &key : keys)
+			hashes.push_back(key_hash(key));
+		return hashes;
+	}
+
+	template<typename SketchT, typename FuncT>
+	void for_each_prefetched(const SketchT &sketch, const std::vector<std::uint64_t> &hashes, FuncT &&func)
+	{
+		for (std::size_t i = 0; i < hashes.size(); ++i) {
+			if (i + prefetch_distance < hashes.size())
+				sketch.prefetch_for(hashes[i + prefetch_distance]);
+			func(hashes[i]);
+		}
+	}
+}
+
+using bloom_type = std::shared_ptr<bitwise_sketch::bloom_filter>;
+using count_min_type = std::shared_ptr<bitwise_sketch::count_min>;
+using hyperloglog_type = std::shared_ptr<bitwise_sketch::hyperloglog>;
+
 CNI_ROOT_NAMESPACE {
 	bitset_t from_string(const std::string &data)
 	{
@@ -30,6 +2949,201 @@ CNI_ROOT_NAMESPACE {
 
 	CNI_CONST_V(hex_literal, from_string)
 
+	CNI_V(compile, [](const std::string &expr) {
+		return std::make_shared<bitexpr_t>(expr);
+	})
+
+	CNI_NAMESPACE(expression)
+	{
+		CNI_CONST_V(source, [](const bitexpr_type &expr) {
+			return expr->str();
+		})
+		CNI_CONST_V(inputs, [](const bitexpr_type &expr) {
+			cs::var ret = cs::var::make<cs::array>();
+			cs::array &arr = ret.val<cs::array>();
+			for (auto &name : expr->inputs())
+				arr.emplace_back(cs::var::make<cs::string>(name));
+			return ret;
+		})
+		CNI_CONST_V(eval, [](const bitexpr_type &expr, const cs::array &args) {
+			if (args.size() != expr->inputs().size())
+				throw cs::lang_error("Wrong size of bit expression inputs.");
+			std::uint64_t values[bitexpr_t::max_inputs];
+			for (std::size_t i = 0; i < args.size(); ++i)
+				values[i] = to_word(args[i]);
+			return bitset_t(expr->eval(values));
+		})
+		CNI_CONST_V(eval_map, [](const bitexpr_type &expr, const cs::hash_map &args) {
+			std::uint64_t values[bitexpr_t::max_inputs];
+			std::size_t found = 0;
+			for (auto &it : args) {
+				if (it.first.type() != typeid(cs::string))
+					throw cs::lang_error("Bit expression input name must be string.");
+				std::size_t idx = expr->index_of(it.first.const_val<cs::string>());
+				if (idx != bitexpr_t::npos) {
+					values[idx] = to_word(it.second);
+					++found;
+				}
+			}
+			if (found != expr->inputs().size())
+				throw cs::lang_error("Missing bit expression inputs.");
+			return bitset_t(expr->eval(values));
+		})
+	}
+
+	CNI_NAMESPACE(codec)
+	{
+		CNI_CONST_V(zigzag_encode, [](const cs::array &arr) {
+			cs::var ret = cs::var::make<cs::array>();
+			cs::array &out = ret.val<cs::array>();
+			for (auto &it : arr)
+				out.emplace_back(cs::numeric(static_cast<std::int64_t>(bitwise_codec::zigzag(bitwise_codec::to_integer(it)))));
+			return ret;
+		})
+		CNI_CONST_V(zigzag_decode, [](const cs::array &arr) {
+			cs::var ret = cs::var::make<cs::array>();
+			cs::array &out = ret.val<cs::array>();
+			for (auto &it : arr)
+				out.emplace_back(cs::numeric(bitwise_codec::unzigzag(static_cast<std::uint64_t>(bitwise_codec::to_integer(it)))));
+			return ret;
+		})
+		CNI_CONST_V(varint_encode, [](const cs::array &arr) {
+			std::string out;
+			out.reserve(arr.size());
+			for (auto &it : arr) {
+				std::int64_t v = bitwise_codec::to_integer(it);
+				if (v < 0)
+					throw cs::lang_error("Varint input must not be negative, use svarint_encode.");
+				bitwise_codec::put_varint(out, v);
+			}
+			return out;
+		})
+		CNI_CONST_V(varint_decode, [](const std::string &str) {
+			std::vector<std::uint64_t> values;
+			values.reserve(str.size());
+			bitwise_codec::reader(str).varints(values);
+			return bitwise_codec::to_array(values);
+		})
+		CNI_CONST_V(svarint_encode, [](const cs::array &arr) {
+			std::string out;
+			out.reserve(arr.size());
+			for (auto &it : arr)
+				bitwise_codec::put_varint(out, bitwise_codec::zigzag(bitwise_codec::to_integer(it)));
+			return out;
+		})
+		CNI_CONST_V(svarint_decode, [](const std::string &str) {
+			std::vector<std::uint64_t> values;
+			values.reserve(str.size());
+			bitwise_codec::reader(str).varints(values);
+			for (auto &v : values)
+				v = static_cast<std::uint64_t>(bitwise_codec::unzigzag(v));
+			return bitwise_codec::to_array(values);
+		})
+		CNI_CONST_V(bitpack_width, [](const cs::array &arr) -> cs::numeric {
+			std::uint64_t span = 0;
+			for (auto &it : arr)
+				span |= static_cast<std::uint64_t>(bitwise_codec::to_integer(it));
+			return bitwise_codec::bit_width(span);
+		})
+		CNI_CONST_V(bitpack_encode, [](const cs::array &arr, std::size_t width) {
+			if (width > 64)
+				throw cs::lang_error("Bit width must be in [0, 64].");
+			std::vector<std::uint64_t> values;
+			values.reserve(arr.size());
+			for (auto &it : arr) {
+				std::uint64_t v = static_cast<std::uint64_t>(bitwise_codec::to_integer(it));
+				if (bitwise_codec::bit_width(v) > width)
+					throw cs::lang_error("Value does not fit in bit width.");
+				values.push_back(v);
+			}
+			std::string out;
+			bitwise_codec::pack(out, values.data(), values.size(), static_cast<unsigned>(width));
+			return out;
+		})
+		CNI_CONST_V(bitpack_decode, [](const std::string &str, std::size_t width, std::size_t count) {
+			if (width > 64)
+				throw cs::lang_error("Bit width must be in [0, 64].");
+			if (width != 0 && str.size() < bitwise_codec::packed_bytes(count, static_cast<unsigned>(width)))
+				throw cs::lang_error("Truncated bit-packed data.");
+			if (width == 0 && count > bitwise_codec::max_zero_width_count)
+				throw cs::lang_error("Too many values for zero-width bit-packed data.");
+			std::vector<std::uint64_t> values(count, 0);
+			if (width != 0)
+				bitwise_codec::unpack(reinterpret_cast<const unsigned char *>(str.data()), str.size(), values.data(), count, static_cast<unsigned>(width));
+			return bitwise_codec::to_array(values);
+		})
+		CNI_CONST_V(for_encode, [](const cs::array &arr) {
+			std::string out;
+			bitwise_codec::for_encode(out, bitwise_codec::to_integers(arr));
+			return out;
+		})
+		CNI_CONST_V(for_decode, [](const std::string &str) {
+			return bitwise_codec::to_array(bitwise_codec::for_decode(str));
+		})
+		// Deltas against the previous value, stored frame-of-reference packed
+		CNI_CONST_V(delta_encode, [](const cs::array &arr) {
+			std::vector<std::int64_t> values = bitwise_codec::to_integers(arr);
+			for (std::size_t i = values.size(); i-- > 1;)
+				values[i] = static_cast<std::int64_t>(static_cast<std::uint64_t>(values[i]) - static_cast<std::uint64_t>(values[i - 1]));
+			std::string out;
+			bitwise_codec::for_encode(out, values);
+			return out;
+		})
+		CNI_CONST_V(delta_decode, [](const std::string &str) {
+			std::vector<std::int64_t> values = bitwise_codec::for_decode(str);
+			for (std::size_t i = 1; i < values.size(); ++i)
+				values[i] = static_cast<std::int64_t>(static_cast<std::uint64_t>(values[i]) + static_cast<std::uint64_t>(values[i - 1]));
+			return bitwise_codec::to_array(values);
+		})
+	}
+
+	CNI_NAMESPACE(hash)
+	{
+		CNI_CONST_V(xxh3_64, [](const std::string &data) {
+			return bitset_t(bitwise_hash::xxh3_64(bitwise_hash::bytes(data), data.size(), 0));
+		})
+		CNI_CONST_V(xxh3_64_seed, [](const std::string &data, const cs::var &seed) {
+			return bitset_t(bitwise_hash::xxh3_64(bitwise_hash::bytes(data), data.size(), to_word(seed)));
+		})
+		CNI_CONST_V(xxh3_128, [](const std::string &data) {
+			return bitwise_hash::to_pair(bitwise_hash::xxh3_128(bitwise_hash::bytes(data), data.size(), 0));
+		})
+		CNI_CONST_V(xxh3_128_seed, [](const std::string &data, const cs::var &seed) {
+			return bitwise_hash::to_pair(bitwise_hash::xxh3_128(bitwise_hash::bytes(data), data.size(), to_word(seed)));
+		})
+		CNI_CONST_V(wyhash, [](const std::string &data) {
+			return bitset_t(bitwise_hash::wyhash(bitwise_hash::bytes(data), data.size(), 0));
+		})
+		CNI_CONST_V(wyhash_seed, [](const std::string &data, const cs::var &seed) {
+			return bitset_t(bitwise_hash::wyhash(bitwise_hash::bytes(data), data.size(), to_word(seed)));
+		})
+		CNI_CONST_V(fnv1a, [](const std::string &data) {
+			return bitset_t(bitwise_hash::fnv1a(bitwise_hash::fnv_offset_basis, bitwise_hash::bytes(data), data.size()));
+		})
+		CNI_CONST_V(fnv1a_seed, [](const std::string &data, const cs::var &seed) {
+			return bitset_t(bitwise_hash::fnv1a(bitwise_hash::fnv_offset_basis ^ to_word(seed), bitwise_hash::bytes(data), data.size()));
+		})
+	}
+
+	CNI_CONST_V(crc32, [](const std::string &data) -> cs::numeric {
+		return bitwise_crc::update(bitwise_crc::crc32_raw, 0, data);
+	})
+	CNI_CONST_V(crc32_update, [](const cs::numeric &crc, const std::string &data) {
+		return bitwise_crc::update_numeric(bitwise_crc::crc32_raw, crc, data);
+	})
+	CNI_V(crc32_file, [](const std::string &path) {
+		return bitwise_crc::checksum_file(bitwise_crc::crc32_raw, path);
+	})
+	CNI_CONST_V(crc32c, [](const std::string &data) -> cs::numeric {
+		return bitwise_crc::update(bitwise_crc::crc32c_raw, 0, data);
+	})
+	CNI_CONST_V(crc32c_update, [](const cs::numeric &crc, const std::string &data) {
+		return bitwise_crc::update_numeric(bitwise_crc::crc32c_raw, crc, data);
+	})
+	CNI_V(crc32c_file, [](const std::string &path) {
+		return bitwise_crc::checksum_file(bitwise_crc::crc32c_raw, path);
+	})
+
 	CNI_TYPE_EXT(bitset, bitset_t, bitset_t())
 	{
 		CNI_CONST_V(test,  &bitset_t::test)
@@ -73,6 +3187,24 @@ CNI_ROOT_NAMESPACE {
 		CNI_CONST_V(shift_right, [](const bitset_t &val, std::size_t pos) {
 			return val >> pos;
 		})
+		CNI_CONST_V(and_assign, [](bitset_t &lhs, const bitset_t &rhs) {
+			lhs &= rhs;
+		})
+		CNI_CONST_V(or_assign, [](bitset_t &lhs, const bitset_t &rhs) {
+			lhs |= rhs;
+		})
+		CNI_CONST_V(xor_assign, [](bitset_t &lhs, const bitset_t &rhs) {
+			lhs ^= rhs;
+		})
+		CNI_CONST_V(not_assign, [](bitset_t &val) {
+			val.flip();
+		})
+		CNI_CONST_V(shl_assign, [](bitset_t &val, std::size_t pos) {
+			val <<= pos;
+		})
+		CNI_CONST_V(shr_assign, [](bitset_t &val, std::size_t pos) {
+			val >>= pos;
+		})
 		CNI_CONST_V(to_hash, [](const bitset_t &val) {
 			return cs::var(val.to_ullong());
 		})
@@ -87,6 +3219,306 @@ CNI_ROOT_NAMESPACE {
 		})
 		CNI_CONST(from_string)
 	}
+
+	CNI_TYPE_EXT(bitvec, bitvec_t, bitvec_t())
+	{
+		CNI_CONST_V(create, [](std::size_t size) {
+			return bitvec_t(size);
+		})
+		CNI_CONST_V(from_string, [](const std::string &str) {
+			return bitvec_t::from_string(str);
+		})
+		CNI_CONST_V(size,  &bitvec_t::size)
+		CNI_CONST_V(test,  &bitvec_t::test)
+		CNI_CONST_V(all,   &bitvec_t::all)
+		CNI_CONST_V(any,   &bitvec_t::any)
+		CNI_CONST_V(none,  &bitvec_t::none)
+		CNI_CONST_V(count, &bitvec_t::count)
+		CNI_CONST_V(rank,  &bitvec_t::rank)
+		CNI_CONST_V(find_first, [](const bitvec_t &val) {
+			return bitvec_position(val.find_first());
+		})
+		CNI_CONST_V(find_next, [](const bitvec_t &val, std::size_t pos) {
+			return bitvec_position(val.find_next(pos));
+		})
+		CNI_CONST_V(resize, [](bitvec_t &val, std::size_t size) {
+			val.resize(size);
+		})
+		CNI_CONST_V(set_all, [](bitvec_t &val) {
+			val.set_all();
+		})
+		CNI_CONST_V(set, [](bitvec_t &val, std::size_t pos) {
+			val.set(pos);
+		})
+		CNI_CONST_V(reset_all, [](bitvec_t &val) {
+			val.reset_all();
+		})
+		CNI_CONST_V(reset, [](bitvec_t &val, std::size_t pos) {
+			val.reset(pos);
+		})
+		CNI_CONST_V(flip_all, [](bitvec_t &val) {
+			val.flip_all();
+		})
+		CNI_CONST_V(flip, [](bitvec_t &val, std::size_t pos) {
+			val.flip(pos);
+		})
+		CNI_CONST_V(logic_and,    &bitvec_binary<bitwise_kernels::bitwise_and>)
+		CNI_CONST_V(logic_or,     &bitvec_binary<bitwise_kernels::bitwise_or>)
+		CNI_CONST_V(logic_xor,    &bitvec_binary<bitwise_kernels::bitwise_xor>)
+		CNI_CONST_V(logic_andnot, &bitvec_binary<bitwise_kernels::bitwise_andnot>)
+		CNI_CONST_V(logic_not, [](const bitvec_t &val) {
+			bitvec_t ret(val);
+			ret.flip_all();
+			return ret;
+		})
+		CNI_CONST_V(and_assign,    &bitvec_assign<bitwise_kernels::bitwise_and>)
+		CNI_CONST_V(or_assign,     &bitvec_assign<bitwise_kernels::bitwise_or>)
+		CNI_CONST_V(xor_assign,    &bitvec_assign<bitwise_kernels::bitwise_xor>)
+		CNI_CONST_V(andnot_assign, &bitvec_assign<bitwise_kernels::bitwise_andnot>)
+		CNI_CONST_V(shift_left, [](const bitvec_t &val, std::size_t pos) {
+			bitvec_t ret(val);
+			ret.shift_left(pos);
+			return ret;
+		})
+		CNI_CONST_V(shift_right, [](const bitvec_t &val, std::size_t pos) {
+			bitvec_t ret(val);
+			ret.shift_right(pos);
+			return ret;
+		})
+		CNI_CONST_V(shl_assign, [](bitvec_t &val, std::size_t pos) {
+			val.shift_left(pos);
+		})
+		CNI_CONST_V(shr_assign, [](bitvec_t &val, std::size_t pos) {
+			val.shift_right(pos);
+		})
+		CNI_CONST_V(to_string, [](const bitvec_t &val) {
+			return val.to_string();
+		})
+	}
+
+	CNI_TYPE_EXT(roaring, roaring_t, roaring_t())
+	{
+		CNI_CONST_V(from_array, [](const cs::array &values) {
+			roaring_t ret;
+			for (auto &it : values)
+				ret.add(roaring_value(it.const_val<cs::numeric>()));
+			return ret;
+		})
+		CNI_CONST_V(deserialize, [](const std::string &data) {
+			return roaring_t::deserialize(data);
+		})
+		CNI_CONST_V(add, [](roaring_t &val, const cs::numeric &v) {
+			return val.add(roaring_value(v));
+		})
+		CNI_CONST_V(add_many, [](roaring_t &val, const cs::array &values) {
+			for (auto &it : values)
+				val.add(roaring_value(it.const_val<cs::numeric>()));
+		})
+		CNI_CONST_V(add_range, [](roaring_t &val, const cs::numeric &lo, const cs::numeric &hi) {
+			if (!hi.is_integer() || hi.as_integer() < 0 || hi.as_integer() > (std::int64_t(1) << 32))
+				throw cs::lang_error("Roaring bitmap range end must be an integer in [0, 2^32].");
+			val.add_range(roaring_value(lo), hi.as_integer());
+		})
+		CNI_CONST_V(remove, [](roaring_t &val, const cs::numeric &v) {
+			return val.remove(roaring_value(v));
+		})
+		CNI_CONST_V(contains, [](const roaring_t &val, const cs::numeric &v) {
+			return val.contains(roaring_value(v));
+		})
+		CNI_CONST_V(cardinality, [](const roaring_t &val) -> cs::numeric {
+			return val.cardinality();
+		})
+		CNI_CONST_V(empty, [](const roaring_t &val) {
+			return val.empty();
+		})
+		CNI_CONST_V(clear, [](roaring_t &val) {
+			val.clear();
+		})
+		CNI_CONST_V(min, [](const roaring_t &val) -> cs::numeric {
+			return val.min();
+		})
+		CNI_CONST_V(max, [](const roaring_t &val) -> cs::numeric {
+			return val.max();
+		})
+		CNI_CONST_V(next_value, [](const roaring_t &val, const cs::numeric &v) -> cs::numeric {
+			return val.next_value(roaring_value(v));
+		})
+		CNI_CONST_V(to_array, [](const roaring_t &val) {
+			cs::var ret = cs::var::make<cs::array>();
+			cs::array &arr = ret.val<cs::array>();
+			val.for_each([&arr](std::uint32_t v) {
+				arr.emplace_back(cs::numeric(v));
+			});
+			return ret;
+		})
+		CNI_CONST_V(equals, [](const roaring_t &lhs, const roaring_t &rhs) {
+			return lhs.equals(rhs);
+		})
+		CNI_CONST_V(logic_and,    &roaring_binary<bitwise_roaring::setop::op_and>)
+		CNI_CONST_V(logic_or,     &roaring_binary<bitwise_roaring::setop::op_or>)
+		CNI_CONST_V(logic_xor,    &roaring_binary<bitwise_roaring::setop::op_xor>)
+		CNI_CONST_V(logic_andnot, &roaring_binary<bitwise_roaring::setop::op_andnot>)
+		CNI_CONST_V(and_assign,    &roaring_assign<bitwise_roaring::setop::op_and>)
+		CNI_CONST_V(or_assign,     &roaring_assign<bitwise_roaring::setop::op_or>)
+		CNI_CONST_V(xor_assign,    &roaring_assign<bitwise_roaring::setop::op_xor>)
+		CNI_CONST_V(andnot_assign, &roaring_assign<bitwise_roaring::setop::op_andnot>)
+		CNI_CONST_V(optimize, [](roaring_t &val) {
+			val.optimize();
+		})
+		CNI_CONST_V(serialize, [](const roaring_t &val) {
+			return val.serialize();
+		})
+	}
+
+	CNI_TYPE_EXT(hasher, hasher_t, hasher_t())
+	{
+		CNI_V(xxh3, [](const cs::var &seed) {
+			return hasher_t(hasher_t::algorithm::xxh3, to_word(seed));
+		})
+		CNI_V(fnv1a, [](const cs::var &seed) {
+			return hasher_t(hasher_t::algorithm::fnv1a, to_word(seed));
+		})
+		CNI_CONST_V(update, [](hasher_t &val, const std::string &data) {
+			val.update(data);
+		})
+		CNI_CONST_V(digest, [](const hasher_t &val) {
+			return bitset_t(val.digest());
+		})
+		CNI_CONST_V(digest128, [](const hasher_t &val) {
+			return bitwise_hash::to_pair(val.digest128());
+		})
+		CNI_CONST_V(reset, [](hasher_t &val) {
+			val.reset();
+		})
+	}
+
+	CNI_NAMESPACE(bloom)
+	{
+		CNI_V(create, [](const cs::numeric &expected, const cs::numeric &fpp) {
+			return bitwise_sketch::bloom_filter::create(static_cast<double>(expected.as_float()), static_cast<double>(fpp.as_float()));
+		})
+		CNI_V(deserialize, &bitwise_sketch::bloom_filter::deserialize)
+		CNI_CONST_V(add, [](const bloom_type &val, const cs::var &key) {
+			val->add(bitwise_sketch::key_hash(key));
+		})
+		CNI_CONST_V(contains, [](const bloom_type &val, const cs::var &key) {
+			return val->contains(bitwise_sketch::key_hash(key));
+		})
+		CNI_CONST_V(add_many, [](const bloom_type &val, const cs::array &keys) {
+			bitwise_sketch::for_each_prefetched(*val, bitwise_sketch::hash_all(keys), [&val](std::uint64_t hash) {
+				val->add(hash);
+			});
+		})
+		CNI_CONST_V(contains_many, [](const bloom_type &val, const cs::array &keys) {
+			cs::var ret = cs::var::make<cs::array>();
+			cs::array &arr = ret.val<cs::array>();
+			bitwise_sketch::for_each_prefetched(*val, bitwise_sketch::hash_all(keys), [&val, &arr](std::uint64_t hash) {
+				arr.emplace_back(val->contains(hash));
+			});
+			return ret;
+		})
+		CNI_CONST_V(merge, [](const bloom_type &val, const bloom_type &other) {
+			val->merge(*other);
+		})
+		CNI_CONST_V(clear, [](const bloom_type &val) {
+			val->clear();
+		})
+		CNI_CONST_V(bit_count, [](const bloom_type &val) -> cs::numeric {
+			return val->bit_count();
+		})
+		CNI_CONST_V(hash_count, [](const bloom_type &val) -> cs::numeric {
+			return val->hash_count();
+		})
+		CNI_CONST_V(serialize, [](const bloom_type &val) {
+			return val->serialize();
+		})
+	}
+
+	CNI_NAMESPACE(count_min)
+	{
+		CNI_V(create, [](const cs::numeric &epsilon, const cs::numeric &delta) {
+			return bitwise_sketch::count_min::create(static_cast<double>(epsilon.as_float()), static_cast<double>(delta.as_float()));
+		})
+		CNI_V(deserialize, &bitwise_sketch::count_min::deserialize)
+		CNI_CONST_V(add, [](const count_min_type &val, const cs::var &key, const cs::numeric &count) {
+			if (!count.is_integer() || count.as_integer() < 0)
+				throw cs::lang_error("Count-min increment must be a non-negative integer.");
+			val->add(bitwise_sketch::key_hash(key), count.as_integer());
+		})
+		CNI_CONST_V(estimate, [](const count_min_type &val, const cs::var &key) -> cs::numeric {
+			return val->estimate(bitwise_sketch::key_hash(key));
+		})
+		CNI_CONST_V(add_many, [](const count_min_type &val, const cs::array &keys) {
+			bitwise_sketch::for_each_prefetched(*val, bitwise_sketch::hash_all(keys), [&val](std::uint64_t hash) {
+				val->add(hash, 1);
+			});
+		})
+		CNI_CONST_V(estimate_many, [](const count_min_type &val, const cs::array &keys) {
+			cs::var ret = cs::var::make<cs::array>();
+			cs::array &arr = ret.val<cs::array>();
+			bitwise_sketch::for_each_prefetched(*val, bitwise_sketch::hash_all(keys), [&val, &arr](std::uint64_t hash) {
+				arr.emplace_back(cs::numeric(val->estimate(hash)));
+			});
+			return ret;
+		})
+		CNI_CONST_V(merge, [](const count_min_type &val, const count_min_type &other) {
+			val->merge(*other);
+		})
+		CNI_CONST_V(clear, [](const count_min_type &val) {
+			val->clear();
+		})
+		CNI_CONST_V(width, [](const count_min_type &val) -> cs::numeric {
+			return val->get_width();
+		})
+		CNI_CONST_V(depth, [](const count_min_type &val) -> cs::numeric {
+			return val->get_depth();
+		})
+		CNI_CONST_V(serialize, [](const count_min_type &val) {
+			return val->serialize();
+		})
+	}
+
+	CNI_NAMESPACE(hyperloglog)
+	{
+		CNI_V(create, [](const cs::numeric &precision) {
+			if (!precision.is_integer())
+				throw cs::lang_error("HyperLogLog precision must be in [4, 18].");
+			cs::numeric_integer p = precision.as_integer();
+			if (p < 4 || p > 18)
+				throw cs::lang_error("HyperLogLog precision must be in [4, 18].");
+			return std::make_shared<bitwise_sketch::hyperloglog>(static_cast<unsigned>(p));
+		})
+		CNI_V(deserialize, &bitwise_sketch::hyperloglog::deserialize)
+		CNI_CONST_V(add, [](const hyperloglog_type &val, const cs::var &key) {
+			val->add(bitwise_sketch::key_hash(key));
+		})
+		CNI_CONST_V(add_many, [](const hyperloglog_type &val, const cs::array &keys) {
+			for (auto &key : keys)
+				val->add(bitwise_sketch::key_hash(key));
+		})
+		CNI_CONST_V(estimate, [](const hyperloglog_type &val) -> cs::numeric {
+			return std::round(val->estimate());
+		})
+		CNI_CONST_V(merge, [](const hyperloglog_type &val, const hyperloglog_type &other) {
+			val->merge(*other);
+		})
+		CNI_CONST_V(clear, [](const hyperloglog_type &val) {
+			val->clear();
+		})
+		CNI_CONST_V(precision, [](const hyperloglog_type &val) -> cs::numeric {
+			return val->get_precision();
+		})
+		CNI_CONST_V(serialize, [](const hyperloglog_type &val) {
+			return val->serialize();
+		})
+	}
 }
 
-CNI_ENABLE_TYPE_EXT_V(bitset, bitset_t, cs::bitset)
\ No newline at end of file
+CNI_ENABLE_TYPE_EXT_V(bitset, bitset_t, cs::bitset)
+CNI_ENABLE_TYPE_EXT_V(bitvec, bitvec_t, cs::bitvec)
+CNI_ENABLE_TYPE_EXT_V(expression, bitexpr_type, cs::bitwise_expression)
+CNI_ENABLE_TYPE_EXT_V(roaring, roaring_t, cs::roaring)
+CNI_ENABLE_TYPE_EXT_V(hasher, hasher_t, cs::hasher)
+CNI_ENABLE_TYPE_EXT_V(bloom, bloom_type, cs::bloom_filter)
+CNI_ENABLE_TYPE_EXT_V(count_min, count_min_type, cs::count_min_sketch)
+CNI_ENABLE_TYPE_EXT_V(hyperloglog, hyperloglog_type, cs::hyperloglog)
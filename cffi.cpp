@@ -3,6 +3,18 @@
 #include <covscript/dll.hpp>
 #include <cstring>
 #include <cstdint>
+#include <algorithm>
+#include <unordered_map>
+#include <exception>
+#include <atomic>
+#include <array>
+#include <map>
+#include <condition_variable>
+#include <functional>
+#include <chrono>
+#include <thread>
+#include <deque>
+#include <mutex>
 #include <ffi.h>
 
 enum class cffi_type {
@@ -11,9 +23,15 @@ enum class cffi_type {
 	ffi_uchar, ffi_ushort, ffi_uint, ffi_ulong,
 	ffi_sint8, ffi_sint16, ffi_sint32, ffi_sint64,
 	ffi_uint8, ffi_uint16, ffi_uint32, ffi_uint64,
-	ffi_string
+	ffi_string, ffi_string_ref, ffi_bytes
 };
 
+// String types which point into script owned memory or expand to two arguments
+bool is_borrowed(cffi_type t) noexcept
+{
+	return t == cffi_type::ffi_string_ref || t == cffi_type::ffi_bytes;
+}
+
 bool is_integer(cffi_type t) noexcept
 {
 	switch (t) {
@@ -58,6 +76,8 @@ ffi_type* get_actual_type(cffi_type t) noexcept
 		return &ffi_type_void;
 	case cffi_type::ffi_pointer:
 	case cffi_type::ffi_string:
+	case cffi_type::ffi_string_ref:
+	case cffi_type::ffi_bytes:
 		return &ffi_type_pointer;
 	case cffi_type::ffi_double:
 		return &ffi_type_double;
@@ -98,260 +118,1187 @@ ffi_type* get_actual_type(cffi_type t) noexcept
 	}
 }
 
-struct resource_holder {
-	resource_holder() = default;
-	resource_holder(const resource_holder&) = delete;
-	resource_holder(resource_holder &&) noexcept = delete;
-	virtual ~resource_holder() = default;
-	virtual cs::var get_var() const = 0;
-	virtual void *get_ptr() const = 0;
-};
+// Native memory buffer, views share the storage of their base buffer
 
-template<typename T>
-struct resource_holder_impl final : public resource_holder {
-	T data;
-	template<typename ...ArgsT>
-	resource_holder_impl(ArgsT &&...args) : data(std::forward<ArgsT>(args)...) {}
-	virtual ~resource_holder_impl() = default;
-	virtual cs::var get_var() const
+class cffi_buffer final {
+	std::shared_ptr<unsigned char> storage;
+	std::size_t offset = 0;
+	std::size_t length = 0;
+public:
+	explicit cffi_buffer(std::size_t size) : storage(new unsigned char[size](), std::default_delete<unsigned char[]>()), length(size) {}
+	cffi_buffer(const cffi_buffer &base, std::size_t off, std::size_t size) : storage(base.storage), offset(base.offset + off), length(size)
+	{
+		base.check_range(off, size);
+	}
+	unsigned char *data() const noexcept
+	{
+		return storage.get() + offset;
+	}
+	std::size_t size() const noexcept
+	{
+		return length;
+	}
+	void check_range(std::size_t off, std::size_t size) const
+	{
+		if (off > length || size > length - off)
+			throw cs::lang_error("Buffer access out of range.");
+	}
+	template<typename T>
+	T get(std::size_t index) const
 	{
-		return data;
+		if (index >= length / sizeof(T))
+			throw cs::lang_error("Buffer access out of range.");
+		T val;
+		std::memcpy(&val, data() + index * sizeof(T), sizeof(T));
+		return val;
 	}
-	virtual void *get_ptr() const
+	template<typename T>
+	void set(std::size_t index, T val)
 	{
-		return (void*)&data;
+		if (index >= length / sizeof(T))
+			throw cs::lang_error("Buffer access out of range.");
+		std::memcpy(data() + index * sizeof(T), &val, sizeof(T));
 	}
 };
 
-// Optimize for numeric
+using buffer_type = std::shared_ptr<cffi_buffer>;
 
-template<typename T>struct numeric_holder {};
+template<typename T>
+cs::numeric buffer_get(const buffer_type &buff, std::size_t index)
+{
+	return buff->get<T>(index);
+}
 
 template<typename T>
-struct resource_holder_impl<numeric_holder<T>> final : public resource_holder {
-	T data;
-	resource_holder_impl() = default;
-	resource_holder_impl(T val) : data(val) {}
-	virtual cs::var get_var() const {
-		return cs::var::make<cs::numeric>(data);
+void buffer_set(buffer_type &buff, std::size_t index, const cs::numeric &val)
+{
+	if constexpr (std::is_floating_point<T>::value)
+		buff->set<T>(index, static_cast<T>(val.as_float()));
+	else
+		buff->set<T>(index, static_cast<T>(val.as_integer()));
+}
+
+// Opt-in per-symbol profiling, costs one relaxed load per call when disabled
+
+std::atomic<bool> cffi_profiling(false);
+
+enum cffi_phase : std::size_t {
+	phase_marshal, phase_call, phase_unmarshal, phase_count
+};
+
+class cffi_func_stats final {
+	template<typename T>
+	using counters = std::array<std::atomic<T>, phase_count>;
+public:
+	// Latency buckets by power of two nanoseconds
+	static constexpr std::size_t histogram_size = 40;
+
+	std::atomic<std::uint64_t> calls;
+	counters<std::uint64_t> total_ns;
+	counters<std::uint64_t> max_ns;
+	std::array<std::atomic<std::uint64_t>, histogram_size> histogram;
+
+	cffi_func_stats()
+	{
+		reset();
+	}
+	void reset() noexcept
+	{
+		calls = 0;
+		for (std::size_t i = 0; i < phase_count; ++i)
+			total_ns[i] = max_ns[i] = 0;
+		for (auto &it : histogram)
+			it = 0;
 	}
-	virtual void *get_ptr() const
+	void add_call() noexcept
 	{
-		return (void*)&data;
+		calls.fetch_add(1, std::memory_order_relaxed);
+	}
+	void add_phase(cffi_phase phase, std::uint64_t ns) noexcept
+	{
+		total_ns[phase].fetch_add(ns, std::memory_order_relaxed);
+		std::uint64_t prev = max_ns[phase].load(std::memory_order_relaxed);
+		while (prev < ns && !max_ns[phase].compare_exchange_weak(prev, ns, std::memory_order_relaxed));
+	}
+	void add_latency(std::uint64_t ns) noexcept
+	{
+		std::size_t bucket = 0;
+		while (ns > 1 && bucket + 1 < histogram_size) {
+			ns >>= 1;
+			++bucket;
+		}
+		histogram[bucket].fetch_add(1, std::memory_order_relaxed);
 	}
 };
 
-// Optimize for strings
-
-template<>
-struct resource_holder_impl<const char*> final : public resource_holder {
-	const char *data;
-	resource_holder_impl() = default;
-	resource_holder_impl(const char *str) : data(str) {}
-	virtual ~resource_holder_impl() = default;
-	virtual cs::var get_var() const
+class cffi_stats_registry final {
+	std::mutex mutex;
+	std::map<std::string, std::shared_ptr<cffi_func_stats>> entries;
+public:
+	std::shared_ptr<cffi_func_stats> get(const std::string &name)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto &entry = entries[name];
+		if (!entry)
+			entry = std::make_shared<cffi_func_stats>();
+		return entry;
+	}
+	template<typename T>
+	void for_each(T &&func)
 	{
-		return cs::var::make<cs::string>(data);
+		std::lock_guard<std::mutex> lock(mutex);
+		for (auto &it : entries)
+			func(it.first, *it.second);
 	}
-	virtual void *get_ptr() const
+	static cffi_stats_registry &get_instance()
 	{
-		return (void*)&data;
+		static cffi_stats_registry registry;
+		return registry;
 	}
 };
 
-template<>
-struct resource_holder_impl<cs::string> final : public resource_holder {
-	char *data;
-	resource_holder_impl(const cs::string &str)
+using stats_type = std::shared_ptr<cffi_func_stats>;
+
+class cffi_profile_scope final {
+	using clock_type = std::chrono::steady_clock;
+	cffi_func_stats *stats = nullptr;
+	std::uint64_t phases[phase_count] = {};
+	clock_type::time_point start, last;
+public:
+	explicit cffi_profile_scope(const stats_type &st) noexcept
 	{
-		data = new char[str.size()];
-		std::strcpy(data, str.c_str());
+		if (st && cffi_profiling.load(std::memory_order_relaxed)) {
+			stats = st.get();
+			start = last = clock_type::now();
+		}
 	}
-	virtual ~resource_holder_impl()
+	bool active() const noexcept
 	{
-		delete[] data;
+		return stats != nullptr;
 	}
-	virtual cs::var get_var() const
+	void lap(cffi_phase phase) noexcept
 	{
-		return cs::var::make<cs::string>(data);
+		if (stats != nullptr) {
+			clock_type::time_point now = clock_type::now();
+			phases[phase] += std::chrono::duration_cast<std::chrono::nanoseconds>(now - last).count();
+			last = now;
+		}
 	}
-	virtual void *get_ptr() const
+	void commit(bool latency = true) noexcept
 	{
-		return (void*)&data;
+		if (stats == nullptr)
+			return;
+		stats->add_call();
+		for (std::size_t i = 0; i < phase_count; ++i)
+			if (phases[i] != 0)
+				stats->add_phase(static_cast<cffi_phase>(i), phases[i]);
+		if (latency)
+			stats->add_latency(std::chrono::duration_cast<std::chrono::nanoseconds>(last - start).count());
 	}
 };
 
-resource_holder* make_resource_holder(cffi_type t)  noexcept
+// C-to-script callbacks, defined after the marshalling plan
+
+class cffi_callback;
+
+using callback_type = std::shared_ptr<cffi_callback>;
+
+void *callback_address(const callback_type &);
+
+// Marshalling plan
+
+// Arguments up to this count are marshalled on the stack
+constexpr std::size_t cffi_inline_args = 16;
+
+union cffi_value {
+	std::int64_t i64;
+	std::uint64_t u64;
+	ffi_arg ret;
+	double f64;
+	float f32;
+	void *ptr;
+	long double f80;
+};
+
+struct cffi_slot {
+	cffi_value value;
+	// Only used by arguments which need a private copy, e.g. strings
+	std::unique_ptr<char[]> owned;
+};
+
+template<typename T>
+inline void store_value(cffi_value &dst, T val) noexcept
+{
+	static_assert(sizeof(T) <= sizeof(cffi_value), "Value too large for cffi_value.");
+	std::memcpy(&dst, &val, sizeof(T));
+}
+
+[[noreturn]] void throw_unmatched(const cs::var &val)
+{
+	if (val.type() == typeid(cs::numeric) || val.type() == typeid(cs::string) || val.type() == typeid(void *) || val.type() == typeid(buffer_type) || val.type() == typeid(callback_type))
+		throw cs::lang_error("Unmatched type in arguments.");
+	else
+		throw cs::runtime_error("Unsupported type in cffi.");
+}
+
+template<typename T>
+void marshal_integer(const cs::var &val, cffi_slot &slot)
+{
+	if (val.type() == typeid(cs::numeric)) {
+		const cs::numeric &num = val.const_val<cs::numeric>();
+		if (!num.is_integer())
+			throw cs::lang_error("Unmatched type in arguments.");
+		store_value<T>(slot.value, static_cast<T>(num.as_integer()));
+	}
+	else if (val == cs::null_pointer)
+		store_value<T>(slot.value, 0);
+	else
+		throw_unmatched(val);
+}
+
+template<typename T>
+void marshal_float(const cs::var &val, cffi_slot &slot)
+{
+	if (val.type() == typeid(cs::numeric))
+		store_value<T>(slot.value, static_cast<T>(val.const_val<cs::numeric>().as_float()));
+	else
+		throw_unmatched(val);
+}
+
+void marshal_pointer(const cs::var &val, cffi_slot &slot)
+{
+	if (val.type() == typeid(void *))
+		store_value<void *>(slot.value, val.const_val<void *>());
+	else if (val.type() == typeid(buffer_type))
+		store_value<void *>(slot.value, val.const_val<buffer_type>()->data());
+	else if (val.type() == typeid(callback_type))
+		store_value<void *>(slot.value, callback_address(val.const_val<callback_type>()));
+	else if (val == cs::null_pointer)
+		store_value<void *>(slot.value, nullptr);
+	else
+		throw_unmatched(val);
+}
+
+void marshal_string(const cs::var &val, cffi_slot &slot)
+{
+	if (val.type() != typeid(cs::string))
+		throw_unmatched(val);
+	const cs::string &str = val.const_val<cs::string>();
+	slot.owned.reset(new char[str.size() + 1]);
+	std::memcpy(slot.owned.get(), str.c_str(), str.size() + 1);
+	store_value<char *>(slot.value, slot.owned.get());
+}
+
+// Borrows the buffer of the string for the duration of the call
+void marshal_string_ref(const cs::var &val, cffi_slot &slot)
+{
+	if (val.type() != typeid(cs::string))
+		throw_unmatched(val);
+	store_value<const char *>(slot.value, val.const_val<cs::string>().c_str());
+}
+
+// Expands into a (pointer, length) pair without NUL scan or copy
+void marshal_bytes(const cs::var &val, cffi_slot &data, cffi_slot &size)
+{
+	if (val.type() == typeid(cs::string)) {
+		const cs::string &str = val.const_val<cs::string>();
+		store_value<const char *>(data.value, str.data());
+		store_value<std::size_t>(size.value, str.size());
+	}
+	else if (val.type() == typeid(buffer_type)) {
+		const buffer_type &buff = val.const_val<buffer_type>();
+		store_value<void *>(data.value, buff->data());
+		store_value<std::size_t>(size.value, buff->size());
+	}
+	else if (val == cs::null_pointer) {
+		store_value<void *>(data.value, nullptr);
+		store_value<std::size_t>(size.value, 0);
+	}
+	else
+		throw_unmatched(val);
+}
+
+ffi_type *get_size_type() noexcept
+{
+	return sizeof(std::size_t) == sizeof(std::uint64_t) ? &ffi_type_uint64 : &ffi_type_uint32;
+}
+
+// Read a value of the exact C type from native memory
+
+template<typename T>
+cs::var load_numeric(const void *data)
+{
+	T val;
+	std::memcpy(&val, data, sizeof(T));
+	return cs::var::make<cs::numeric>(val);
+}
+
+cs::var load_pointer(const void *data)
+{
+	void *val;
+	std::memcpy(&val, data, sizeof(void *));
+	return cs::var::make<void *>(val);
+}
+
+cs::var load_string(const void *data)
+{
+	const char *val;
+	std::memcpy(&val, data, sizeof(const char *));
+	if (val == nullptr)
+		return cs::null_pointer;
+	return cs::var::make<cs::string>(val);
+}
+
+cs::var load_void(const void *)
+{
+	return cs::null_pointer;
+}
+
+// libffi widens integral return values narrower than a register to ffi_arg
+template<typename T>
+cs::var unmarshal_integer(const cffi_value &val)
+{
+	if constexpr (sizeof(T) < sizeof(ffi_arg))
+		return cs::var::make<cs::numeric>(static_cast<T>(val.ret));
+	else
+		return load_numeric<T>(&val);
+}
+
+template<cs::var(*load)(const void *)>
+cs::var unmarshal_value(const cffi_value &val)
+{
+	return load(&val);
+}
+
+// Write the result of a callback into libffi return storage
+template<typename T, void(*marshal)(const cs::var &, cffi_slot &)>
+void write_return(const cs::var &val, void *ret)
+{
+	cffi_slot slot;
+	marshal(val, slot);
+	T data;
+	std::memcpy(&data, &slot.value, sizeof(T));
+	if constexpr (std::is_integral<T>::value && sizeof(T) < sizeof(ffi_arg)) {
+		if constexpr (std::is_signed<T>::value) {
+			ffi_sarg widened = data;
+			std::memcpy(ret, &widened, sizeof(ffi_sarg));
+		}
+		else {
+			ffi_arg widened = data;
+			std::memcpy(ret, &widened, sizeof(ffi_arg));
+		}
+	}
+	else
+		std::memcpy(ret, &data, sizeof(T));
+}
+
+struct cffi_converter {
+	void (*marshal)(const cs::var &, cffi_slot &) = nullptr;
+	cs::var (*unmarshal)(const cffi_value &) = nullptr;
+	cs::var (*load)(const void *) = nullptr;
+	void (*write_return)(const cs::var &, void *) = nullptr;
+};
+
+template<typename T>
+constexpr cffi_converter make_integer_converter() noexcept
+{
+	return {&marshal_integer<T>, &unmarshal_integer<T>, &load_numeric<T>, &write_return<T, &marshal_integer<T>>};
+}
+
+template<typename T>
+constexpr cffi_converter make_float_converter() noexcept
+{
+	return {&marshal_float<T>, &unmarshal_value<&load_numeric<T>>, &load_numeric<T>, &write_return<T, &marshal_float<T>>};
+}
+
+cffi_converter get_converter(cffi_type t) noexcept
 {
 	switch (t) {
 	default:
+	case cffi_type::ffi_void:
+		return {nullptr, &unmarshal_value<&load_void>, &load_void};
 	case cffi_type::ffi_pointer:
-		return new resource_holder_impl<void *>();
+		return {&marshal_pointer, &unmarshal_value<&load_pointer>, &load_pointer, &write_return<void *, &marshal_pointer>};
 	case cffi_type::ffi_string:
-		return new resource_holder_impl<const char *>();
+		return {&marshal_string, &unmarshal_value<&load_string>, &load_string};
+	case cffi_type::ffi_string_ref:
+		return {&marshal_string_ref, &unmarshal_value<&load_string>, &load_string};
+	case cffi_type::ffi_bytes:
+		return {nullptr, nullptr, nullptr};
 	case cffi_type::ffi_double:
-		return new resource_holder_impl<numeric_holder<double>>();
+		return make_float_converter<double>();
 	case cffi_type::ffi_float:
-		return new resource_holder_impl<numeric_holder<float>>();
+		return make_float_converter<float>();
 	case cffi_type::ffi_schar:
-		return new resource_holder_impl<char>();
+		return make_integer_converter<signed char>();
 	case cffi_type::ffi_sshort:
-		return new resource_holder_impl<numeric_holder<short>>();
+		return make_integer_converter<short>();
 	case cffi_type::ffi_sint:
-		return new resource_holder_impl<numeric_holder<int>>();
+		return make_integer_converter<int>();
 	case cffi_type::ffi_slong:
-		return new resource_holder_impl<numeric_holder<long>>();
+		return make_integer_converter<long>();
 	case cffi_type::ffi_uchar:
-		return new resource_holder_impl<numeric_holder<unsigned char>>();
+		return make_integer_converter<unsigned char>();
 	case cffi_type::ffi_ushort:
-		return new resource_holder_impl<numeric_holder<unsigned short>>();
+		return make_integer_converter<unsigned short>();
 	case cffi_type::ffi_uint:
-		return new resource_holder_impl<numeric_holder<unsigned int>>();
+		return make_integer_converter<unsigned int>();
 	case cffi_type::ffi_ulong:
-		return new resource_holder_impl<numeric_holder<unsigned long>>();
+		return make_integer_converter<unsigned long>();
 	case cffi_type::ffi_sint8:
-		return new resource_holder_impl<numeric_holder<int8_t>>();
+		return make_integer_converter<std::int8_t>();
 	case cffi_type::ffi_sint16:
-		return new resource_holder_impl<numeric_holder<int16_t>>();
+		return make_integer_converter<std::int16_t>();
 	case cffi_type::ffi_sint32:
-		return new resource_holder_impl<numeric_holder<int32_t>>();
+		return make_integer_converter<std::int32_t>();
 	case cffi_type::ffi_sint64:
-		return new resource_holder_impl<numeric_holder<int64_t>>();
+		return make_integer_converter<std::int64_t>();
 	case cffi_type::ffi_uint8:
-		return new resource_holder_impl<numeric_holder<uint8_t>>();
+		return make_integer_converter<std::uint8_t>();
 	case cffi_type::ffi_uint16:
-		return new resource_holder_impl<numeric_holder<uint16_t>>();
+		return make_integer_converter<std::uint16_t>();
 	case cffi_type::ffi_uint32:
-		return new resource_holder_impl<numeric_holder<uint32_t>>();
+		return make_integer_converter<std::uint32_t>();
 	case cffi_type::ffi_uint64:
-		return new resource_holder_impl<numeric_holder<uint64_t>>();
+		return make_integer_converter<std::uint64_t>();
+	}
+}
+
+// Errors raised by callbacks can not unwind through C frames, they are
+// stored here and rethrown once the outermost native call returns
+
+thread_local std::exception_ptr cffi_callback_error;
+
+void rethrow_callback_error()
+{
+	if (cffi_callback_error) {
+		std::exception_ptr err = cffi_callback_error;
+		cffi_callback_error = nullptr;
+		std::rethrow_exception(err);
+	}
+}
+
+// Struct layouts built from scalar cffi types
+
+class cffi_struct final {
+	std::vector<std::string> names;
+	std::vector<cffi_type> fields;
+	std::vector<cffi_converter> converters;
+	std::vector<ffi_type *> elements;
+	std::vector<std::size_t> offsets;
+	ffi_type type;
+public:
+	cffi_struct(std::vector<std::string> field_names, std::vector<cffi_type> field_types) : names(std::move(field_names)), fields(std::move(field_types))
+	{
+		if (names.size() != fields.size())
+			throw cs::lang_error("Unmatched size of field names and types.");
+		if (fields.empty())
+			throw cs::lang_error("Struct must have at least one field.");
+		for (auto &it : fields) {
+			if (it == cffi_type::ffi_void)
+				throw cs::lang_error("Field type can not be void.");
+			if (it == cffi_type::ffi_string || is_borrowed(it))
+				throw cs::lang_error("String fields are not supported, use pointer instead.");
+			converters.push_back(get_converter(it));
+			elements.push_back(get_actual_type(it));
+		}
+		elements.push_back(nullptr);
+		offsets.resize(fields.size());
+		type.size = 0;
+		type.alignment = 0;
+		type.type = FFI_TYPE_STRUCT;
+		type.elements = elements.data();
+		if (ffi_get_struct_offsets(FFI_DEFAULT_ABI, &type, offsets.data()) != FFI_OK)
+			throw cs::runtime_error("Init libffi struct layout failed!");
+	}
+	cffi_struct(const cffi_struct &) = delete;
+	ffi_type *get_type() noexcept
+	{
+		return &type;
+	}
+	std::size_t size() const noexcept
+	{
+		return type.size;
+	}
+	std::size_t alignment() const noexcept
+	{
+		return type.alignment;
+	}
+	std::size_t field_count() const noexcept
+	{
+		return fields.size();
+	}
+	const std::string &field_name(std::size_t idx) const
+	{
+		return names.at(idx);
+	}
+	std::size_t offset_of(std::size_t idx) const
+	{
+		return offsets.at(idx);
+	}
+	std::size_t index_of(const std::string &name) const
+	{
+		for (std::size_t i = 0; i < names.size(); ++i)
+			if (names[i] == name)
+				return i;
+		throw cs::lang_error("Struct has no field named \"" + name + "\".");
 	}
+	cs::var read(const unsigned char *record, std::size_t idx) const
+	{
+		return converters[idx].load(record + offsets[idx]);
+	}
+	void write(unsigned char *record, std::size_t idx, const cs::var &val) const
+	{
+		cffi_slot slot;
+		converters[idx].marshal(val, slot);
+		std::memcpy(record + offsets[idx], &slot.value, elements[idx]->size);
+	}
+	// Address of a record inside a packed array of this struct
+	unsigned char *record_at(const buffer_type &buff, std::size_t index) const
+	{
+		if (index >= buff->size() / type.size)
+			throw cs::lang_error("Struct array access out of range.");
+		return buff->data() + index * type.size;
+	}
+	std::size_t count_of(const buffer_type &buff) const noexcept
+	{
+		return buff->size() / type.size;
+	}
+};
+
+using struct_type = std::shared_ptr<cffi_struct>;
+
+// A scalar type, or a struct passed by value
+struct cffi_param {
+	cffi_type type = cffi_type::ffi_void;
+	struct_type layout;
+
+	cffi_param() = default;
+	cffi_param(cffi_type t) : type(t) {}
+	cffi_param(struct_type st) : layout(std::move(st)) {}
+
+	static cffi_param from_var(const cs::var &val)
+	{
+		if (val.type() == typeid(cffi_type))
+			return val.const_val<cffi_type>();
+		else if (val.type() == typeid(struct_type))
+			return val.const_val<struct_type>();
+		else
+			throw cs::lang_error("Expected cffi type or struct.");
+	}
+
+	ffi_type *get_type() const noexcept
+	{
+		return layout ? layout->get_type() : get_actual_type(type);
+	}
+};
+
+void *marshal_struct(const cffi_struct &layout, const cs::var &val)
+{
+	if (val.type() != typeid(buffer_type))
+		throw cs::lang_error("Struct arguments must be passed as buffers.");
+	const buffer_type &buff = val.const_val<buffer_type>();
+	if (buff->size() < layout.size())
+		throw cs::lang_error("Buffer is smaller than the struct.");
+	return buff->data();
 }
 
+// Signature-keyed CIF cache for untyped calls
+
+struct cffi_cache_stats_type {
+	std::size_t hits = 0;
+	std::size_t misses = 0;
+} cffi_cache_stats;
+
+class cffi_cif_cache final {
+	struct entry_type {
+		std::vector<ffi_type *> types;
+		ffi_cif cif;
+	};
+	static constexpr std::size_t inline_size = 4;
+	std::pair<std::uint64_t, entry_type *> inline_entries[inline_size] = {};
+	std::size_t inline_next = 0;
+	std::unordered_map<std::uint64_t, std::unique_ptr<entry_type>> entries;
+public:
+	// Argument kinds are packed two bits each above an eight bits argument count
+	static constexpr std::size_t max_args = 28;
+
+	ffi_cif *lookup(std::uint64_t key, ffi_type **types, std::size_t count)
+	{
+		for (auto &it : inline_entries) {
+			if (it.second != nullptr && it.first == key) {
+				++cffi_cache_stats.hits;
+				return &it.second->cif;
+			}
+		}
+		entry_type *entry = nullptr;
+		auto it = entries.find(key);
+		if (it != entries.end()) {
+			++cffi_cache_stats.hits;
+			entry = it->second.get();
+		}
+		else {
+			++cffi_cache_stats.misses;
+			std::unique_ptr<entry_type> data(new entry_type);
+			data->types.assign(types, types + count);
+			if (ffi_prep_cif(&data->cif, FFI_DEFAULT_ABI, count, &ffi_type_void, data->types.data()) != FFI_OK)
+				throw cs::runtime_error("Init libffi CIF failed!");
+			entry = data.get();
+			entries.emplace(key, std::move(data));
+		}
+		inline_entries[inline_next] = {key, entry};
+		inline_next = (inline_next + 1) % inline_size;
+		return &entry->cif;
+	}
+};
+
 class cffi_simple_callable final {
+	enum arg_kind : std::uint64_t {
+		kind_integer = 0, kind_float = 1, kind_pointer = 2
+	};
+	std::shared_ptr<cffi_cif_cache> cache;
+	stats_type stats;
 	void (*target_func)() = nullptr;
-public:
-	cffi_simple_callable(void (*ptr)()) : target_func(ptr) {}
-	cs::var operator()(cs::vector &args) const
+
+	void invoke(cs::vector &args, cffi_slot *slots, void **arg_data, ffi_type **arg_types) const
 	{
-		std::unique_ptr<ffi_type *[]> arg_types(new ffi_type *[args.size()]);
-		std::unique_ptr<void *[]> arg_data(new void *[args.size()]);
-		std::vector<std::unique_ptr<resource_holder>> hosted_res;
+		cffi_profile_scope profile(stats);
+		std::uint64_t key = args.size();
 		for (std::size_t i = 0; i < args.size(); ++i)
 		{
 			const cs::var &it = args[i];
+			arg_kind kind = kind_pointer;
 			if (it.type() == typeid(cs::numeric)) {
 				const cs::numeric &num = it.const_val<cs::numeric>();
 				if (num.is_integer()) {
-					hosted_res.emplace_back(new resource_holder_impl<cs::numeric_integer>(num.as_integer()));
+					slots[i].value.i64 = num.as_integer();
 					arg_types[i] = &ffi_type_sint64;
+					kind = kind_integer;
 				}
 				else {
-					hosted_res.emplace_back(new resource_holder_impl<cs::numeric_float>(num.as_float()));
+					slots[i].value.f80 = num.as_float();
 					arg_types[i] = &ffi_type_longdouble;
+					kind = kind_float;
 				}
 			}
 			else if (it.type() == typeid(cs::string)) {
-				hosted_res.emplace_back(new resource_holder_impl<cs::string>(it.const_val<cs::string>()));
-				arg_types[i] = &ffi_type_pointer;
-			}
-			else if (it.type() == typeid(void *)) {
-				hosted_res.emplace_back(new resource_holder_impl<void *>(it.const_val<void *>()));
+				marshal_string(it, slots[i]);
 				arg_types[i] = &ffi_type_pointer;
 			}
-			else if (it == cs::null_pointer) {
-				hosted_res.emplace_back(new resource_holder_impl<void *>(nullptr));
+			else if (it.type() == typeid(void *) || it.type() == typeid(buffer_type) || it.type() == typeid(callback_type) || it == cs::null_pointer) {
+				marshal_pointer(it, slots[i]);
 				arg_types[i] = &ffi_type_pointer;
 			}
 			else
 				throw cs::runtime_error("Unsupported type in cffi.");
-			arg_data[i] = hosted_res.back()->get_ptr();
+			if (i < cffi_cif_cache::max_args)
+				key |= static_cast<std::uint64_t>(kind) << (8 + 2 * i);
+			arg_data[i] = &slots[i].value;
+		}
+		ffi_cif local_cif, *cif = &local_cif;
+		if (args.size() <= cffi_cif_cache::max_args)
+			cif = cache->lookup(key, arg_types, args.size());
+		else if (ffi_prep_cif(&local_cif, FFI_DEFAULT_ABI, args.size(), &ffi_type_void, arg_types) != FFI_OK)
+			throw cs::runtime_error("Init libffi CIF failed!");
+		profile.lap(phase_marshal);
+		ffi_call(cif, target_func, nullptr, arg_data);
+		profile.lap(phase_call);
+		rethrow_callback_error();
+		profile.commit();
+	}
+public:
+	cffi_simple_callable(void (*ptr)(), stats_type st = nullptr) : cache(std::make_shared<cffi_cif_cache>()), stats(std::move(st)), target_func(ptr) {}
+	cs::var operator()(cs::vector &args) const
+	{
+		if (args.size() <= cffi_inline_args) {
+			cffi_slot slots[cffi_inline_args];
+			void *arg_data[cffi_inline_args];
+			ffi_type *arg_types[cffi_inline_args];
+			invoke(args, slots, arg_data, arg_types);
+		}
+		else {
+			std::unique_ptr<cffi_slot[]> slots(new cffi_slot[args.size()]);
+			std::unique_ptr<void *[]> arg_data(new void *[args.size()]);
+			std::unique_ptr<ffi_type *[]> arg_types(new ffi_type *[args.size()]);
+			invoke(args, slots.get(), arg_data.get(), arg_types.get());
 		}
-		ffi_cif cif;
-		if (ffi_prep_cif(&cif, FFI_DEFAULT_ABI, args.size(), &ffi_type_void, arg_types.get()) == FFI_OK)
-			ffi_call(&cif, target_func, nullptr, arg_data.get());
 		return cs::null_pointer;
 	}
 };
 
-class cffi_callable final {
-	// Properties
-	cffi_type restype = cffi_type::ffi_void;
-	std::vector<cffi_type> argtypes;
-	void (*target_func)() = nullptr;
-	// Internal Data
-	mutable ffi_cif _ffi_cif;
-	std::vector<ffi_type *> _ffi_types;
+// Per-signature marshalling plan, shared between copies of a callable
+
+struct cffi_result {
+	cffi_value value;
+	// Storage of struct return values
+	std::unique_ptr<cffi_buffer> record;
+};
+
+class cffi_plan final {
+	cffi_param restype;
+	std::vector<cffi_param> argtypes;
+	std::vector<cffi_converter> converters;
+	cffi_converter result;
+	// One entry per native argument, bytes arguments take two
+	std::vector<ffi_type *> ffi_types;
+	mutable ffi_cif cif;
 public:
-	cffi_callable(void (*ptr)(), cffi_type rt, std::vector<cffi_type> ats) : target_func(ptr), restype(rt), argtypes(std::move(ats))
+	cffi_plan(cffi_param rt, std::vector<cffi_param> ats) : restype(std::move(rt)), argtypes(std::move(ats))
 	{
-		_ffi_types.resize(argtypes.size());
-		for (std::size_t i = 0; i < argtypes.size(); ++i)
-			_ffi_types[i] = get_actual_type(argtypes[i]);
-		if (ffi_prep_cif(&_ffi_cif, FFI_DEFAULT_ABI, argtypes.size(), get_actual_type(restype), _ffi_types.data()) != FFI_OK)
+		if (!restype.layout && restype.type == cffi_type::ffi_bytes)
+			throw cs::lang_error("Return type can not be bytes.");
+		result = get_converter(restype.type);
+		converters.resize(argtypes.size());
+		for (std::size_t i = 0; i < argtypes.size(); ++i) {
+			const cffi_param &param = argtypes[i];
+			if (!param.layout && param.type == cffi_type::ffi_void)
+				throw cs::lang_error("Argument type can not be void.");
+			converters[i] = get_converter(param.type);
+			if (!param.layout && param.type == cffi_type::ffi_bytes) {
+				ffi_types.push_back(&ffi_type_pointer);
+				ffi_types.push_back(get_size_type());
+			}
+			else
+				ffi_types.push_back(param.get_type());
+		}
+		if (ffi_prep_cif(&cif, FFI_DEFAULT_ABI, ffi_types.size(), restype.get_type(), ffi_types.data()) != FFI_OK)
 			throw cs::runtime_error("Init libffi CIF failed!");
 	}
-	cs::var operator()(cs::vector &args) const
+	cffi_plan(const cffi_plan &) = delete;
+	std::size_t arg_count() const noexcept
+	{
+		return argtypes.size();
+	}
+	std::size_t native_count() const noexcept
+	{
+		return ffi_types.size();
+	}
+	void marshal(cs::vector &args, cffi_slot *slots, void **arg_data) const
 	{
 		if (args.size() != argtypes.size())
 			throw cs::runtime_error("Unmatched argument size.");
-		std::unique_ptr<void *[]> arg_data(new void *[args.size()]);
-		std::vector<std::unique_ptr<resource_holder>> hosted_res;
-		for (std::size_t i = 0; i < args.size(); ++i)
-		{
-			const cs::var &it = args[i];
-			if (it.type() == typeid(cs::numeric)) {
-				const cs::numeric &num = it.const_val<cs::numeric>();
-				if (num.is_integer()) {
-					if (!is_integer(argtypes[i]))
-						throw cs::lang_error("Unmatched type in arguments.");
-					hosted_res.emplace_back(new resource_holder_impl<cs::numeric_integer>(num.as_integer()));
-				}
-				else {
-					if (!is_float(argtypes[i]))
-						throw cs::lang_error("Unmatched type in arguments.");
-					hosted_res.emplace_back(new resource_holder_impl<cs::numeric_float>(num.as_float()));
-				}
+		for (std::size_t i = 0, n = 0; i < args.size(); ++i, ++n) {
+			const cffi_param &param = argtypes[i];
+			if (param.layout)
+				arg_data[n] = marshal_struct(*param.layout, args[i]);
+			else if (param.type == cffi_type::ffi_bytes) {
+				marshal_bytes(args[i], slots[n], slots[n + 1]);
+				arg_data[n] = &slots[n].value;
+				arg_data[n + 1] = &slots[n + 1].value;
+				++n;
 			}
-			else if (it.type() == typeid(cs::string)) {
-				if (argtypes[i] != cffi_type::ffi_string)
-					throw cs::lang_error("Unmatched type in arguments.");
-				hosted_res.emplace_back(new resource_holder_impl<cs::string>(it.const_val<cs::string>()));
+			else {
+				converters[i].marshal(args[i], slots[n]);
+				arg_data[n] = &slots[n].value;
 			}
-			else if (it.type() == typeid(void *)) {
-				if (argtypes[i] != cffi_type::ffi_pointer)
-					throw cs::lang_error("Unmatched type in arguments.");
-				hosted_res.emplace_back(new resource_holder_impl<void *>(it.const_val<void *>()));
+		}
+	}
+	// Replaces borrowed strings with private copies, for calls that run after
+	// the script moved on and may have grown or released the string
+	void detach(const cs::vector &args, cffi_slot *slots) const
+	{
+		for (std::size_t i = 0, n = 0; i < args.size(); ++i, ++n) {
+			const cffi_param &param = argtypes[i];
+			bool bytes = !param.layout && param.type == cffi_type::ffi_bytes;
+			if (!param.layout && is_borrowed(param.type) && args[i].type() == typeid(cs::string)) {
+				const cs::string &str = args[i].const_val<cs::string>();
+				slots[n].owned.reset(new char[str.size() + 1]);
+				std::memcpy(slots[n].owned.get(), str.c_str(), str.size() + 1);
+				store_value<char *>(slots[n].value, slots[n].owned.get());
 			}
-			else if (it == cs::null_pointer) {
-				if (argtypes[i] != cffi_type::ffi_pointer && !is_integer(argtypes[i]))
-					throw cs::lang_error("Unmatched type in arguments.");
-				hosted_res.emplace_back(new resource_holder_impl<void *>(nullptr));
+			if (bytes)
+				++n;
+		}
+	}
+	// Safe to run without the interpreter, it touches native memory only
+	void call(void (*func)(), cffi_result &ret, void **arg_data) const
+	{
+		if (restype.layout) {
+			// Leave room for libffi to write a full register
+			ret.record.reset(new cffi_buffer(std::max(restype.layout->size(), sizeof(ffi_arg))));
+			ffi_call(&cif, func, ret.record->data(), arg_data);
+		}
+		else
+			ffi_call(&cif, func, &ret.value, arg_data);
+	}
+	cs::var unmarshal(const cffi_result &ret) const
+	{
+		if (restype.layout)
+			return std::make_shared<cffi_buffer>(*ret.record, 0, restype.layout->size());
+		else
+			return result.unmarshal(ret.value);
+	}
+};
+
+class cffi_callable final {
+	std::shared_ptr<cffi_plan> plan;
+	stats_type stats;
+	void (*target_func)() = nullptr;
+
+	cs::var invoke(cs::vector &args, cffi_slot *slots, void **arg_data) const
+	{
+		cffi_profile_scope profile(stats);
+		cffi_result ret;
+		plan->marshal(args, slots, arg_data);
+		profile.lap(phase_marshal);
+		plan->call(target_func, ret, arg_data);
+		profile.lap(phase_call);
+		rethrow_callback_error();
+		if (!profile.active())
+			return plan->unmarshal(ret);
+		cs::var val = plan->unmarshal(ret);
+		profile.lap(phase_unmarshal);
+		profile.commit();
+		return val;
+	}
+public:
+	cffi_callable(void (*ptr)(), cffi_param rt, std::vector<cffi_param> ats, stats_type st = nullptr) : plan(std::make_shared<cffi_plan>(std::move(rt), std::move(ats))), stats(std::move(st)), target_func(ptr) {}
+	cs::var operator()(cs::vector &args) const
+	{
+		const std::size_t count = plan->native_count();
+		if (count <= cffi_inline_args) {
+			cffi_slot slots[cffi_inline_args];
+			void *arg_data[cffi_inline_args];
+			return invoke(args, slots, arg_data);
+		}
+		else {
+			std::unique_ptr<cffi_slot[]> slots(new cffi_slot[count]);
+			std::unique_ptr<void *[]> arg_data(new void *[count]);
+			return invoke(args, slots.get(), arg_data.get());
+		}
+	}
+};
+
+// Asynchronous calls, native functions run on a bounded pool of worker threads
+
+thread_local bool cffi_async_worker = false;
+
+class cffi_worker_pool final {
+	std::mutex mutex;
+	std::condition_variable cond;
+	std::deque<std::function<void()>> tasks;
+	std::vector<std::thread> workers;
+	std::size_t max_workers = std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+	std::size_t idle_workers = 0;
+	bool stopped = false;
+
+	void worker_main()
+	{
+		cffi_async_worker = true;
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true) {
+			++idle_workers;
+			cond.wait(lock, [this] {
+				return stopped || !tasks.empty();
+			});
+			--idle_workers;
+			if (tasks.empty())
+				return;
+			std::function<void()> task = std::move(tasks.front());
+			tasks.pop_front();
+			lock.unlock();
+			task();
+			lock.lock();
+		}
+	}
+public:
+	cffi_worker_pool() = default;
+	cffi_worker_pool(const cffi_worker_pool &) = delete;
+	~cffi_worker_pool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopped = true;
+		}
+		cond.notify_all();
+		for (auto &it : workers)
+			it.join();
+	}
+	void set_max_workers(std::size_t count)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		max_workers = std::max<std::size_t>(count, 1);
+	}
+	void post(std::function<void()> task)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			tasks.emplace_back(std::move(task));
+			if (idle_workers < tasks.size() && workers.size() < max_workers)
+				workers.emplace_back(&cffi_worker_pool::worker_main, this);
+		}
+		cond.notify_one();
+	}
+	static cffi_worker_pool &get_instance()
+	{
+		static cffi_worker_pool pool;
+		return pool;
+	}
+};
+
+// Shared by the future and the worker, holds native data only
+struct cffi_async_job {
+	std::shared_ptr<cffi_plan> plan;
+	// Only set while profiling
+	stats_type stats;
+	void (*target_func)() = nullptr;
+	std::unique_ptr<cffi_slot[]> slots;
+	std::unique_ptr<void *[]> arg_data;
+	cffi_result result;
+	std::exception_ptr error;
+	std::mutex mutex;
+	std::condition_variable cond;
+	bool done = false;
+
+	void run()
+	{
+		if (stats) {
+			auto start = std::chrono::steady_clock::now();
+			plan->call(target_func, result, arg_data.get());
+			std::uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+			stats->add_phase(phase_call, ns);
+			stats->add_latency(ns);
+		}
+		else
+			plan->call(target_func, result, arg_data.get());
+		std::lock_guard<std::mutex> lock(mutex);
+		std::swap(error, cffi_callback_error);
+		done = true;
+		cond.notify_all();
+	}
+};
+
+class cffi_future final {
+	std::shared_ptr<cffi_async_job> job;
+	// Keeps buffers and structs alive until the call finished, borrowed
+	// strings were already copied into the job
+	cs::vector args;
+	cs::var value;
+	bool collected = false;
+public:
+	cffi_future(std::shared_ptr<cffi_async_job> j, cs::vector a) : job(std::move(j)), args(std::move(a)) {}
+	cffi_future(const cffi_future &) = delete;
+	~cffi_future()
+	{
+		wait();
+	}
+	bool ready()
+	{
+		std::lock_guard<std::mutex> lock(job->mutex);
+		return job->done;
+	}
+	void wait()
+	{
+		std::unique_lock<std::mutex> lock(job->mutex);
+		job->cond.wait(lock, [this] {
+			return job->done;
+		});
+	}
+	bool wait_for(std::size_t ms)
+	{
+		std::unique_lock<std::mutex> lock(job->mutex);
+		return job->cond.wait_for(lock, std::chrono::milliseconds(ms), [this] {
+			return job->done;
+		});
+	}
+	cs::var get()
+	{
+		wait();
+		if (!collected) {
+			if (job->error)
+				std::rethrow_exception(job->error);
+			if (job->stats) {
+				auto start = std::chrono::steady_clock::now();
+				value = job->plan->unmarshal(job->result);
+				job->stats->add_phase(phase_unmarshal, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
 			}
 			else
-				throw cs::runtime_error("Unsupported type in cffi.");
-			arg_data[i] = hosted_res.back()->get_ptr();
+				value = job->plan->unmarshal(job->result);
+			collected = true;
+		}
+		return value;
+	}
+};
+
+using future_type = std::shared_ptr<cffi_future>;
+
+class cffi_async_callable final {
+	std::shared_ptr<cffi_plan> plan;
+	stats_type stats;
+	void (*target_func)() = nullptr;
+public:
+	cffi_async_callable(void (*ptr)(), cffi_param rt, std::vector<cffi_param> ats, stats_type st = nullptr) : plan(std::make_shared<cffi_plan>(std::move(rt), std::move(ats))), stats(std::move(st)), target_func(ptr) {}
+	cs::var operator()(cs::vector &args) const
+	{
+		cffi_profile_scope profile(stats);
+		auto job = std::make_shared<cffi_async_job>();
+		job->plan = plan;
+		if (profile.active())
+			job->stats = stats;
+		job->target_func = target_func;
+		job->slots.reset(new cffi_slot[plan->native_count()]);
+		job->arg_data.reset(new void *[plan->native_count()]);
+		plan->marshal(args, job->slots.get(), job->arg_data.get());
+		plan->detach(args, job->slots.get());
+		profile.lap(phase_marshal);
+		profile.commit(false);
+		auto future = std::make_shared<cffi_future>(job, args);
+		cffi_worker_pool::get_instance().post([job] {
+			job->run();
+		});
+		return future;
+	}
+};
+
+// Closures are recycled instead of going back to ffi_closure_free
+
+class cffi_closure_pool final {
+	std::vector<std::pair<ffi_closure *, void *>> free_list;
+public:
+	cffi_closure_pool() = default;
+	cffi_closure_pool(const cffi_closure_pool &) = delete;
+	~cffi_closure_pool()
+	{
+		for (auto &it : free_list)
+			ffi_closure_free(it.first);
+	}
+	ffi_closure *acquire(void **code)
+	{
+		if (!free_list.empty()) {
+			auto item = free_list.back();
+			free_list.pop_back();
+			*code = item.second;
+			return item.first;
 		}
-		if (restype != cffi_type::ffi_void)
+		auto closure = static_cast<ffi_closure *>(ffi_closure_alloc(sizeof(ffi_closure), code));
+		if (closure == nullptr)
+			throw cs::runtime_error("Allocate libffi closure failed!");
+		return closure;
+	}
+	void release(ffi_closure *closure, void *code)
+	{
+		free_list.emplace_back(closure, code);
+	}
+	static cffi_closure_pool &get_instance()
+	{
+		static cffi_closure_pool pool;
+		return pool;
+	}
+};
+
+// The native function pointer stays valid as long as the callback object lives,
+// C code must not keep it after the script released the callback.
+class cffi_callback final {
+	cs::callable func;
+	cffi_param restype;
+	std::vector<cffi_param> argtypes;
+	std::vector<cffi_converter> converters;
+	cffi_converter result;
+	std::vector<ffi_type *> ffi_types;
+	ffi_cif cif;
+	ffi_closure *closure = nullptr;
+	void *code = nullptr;
+	// Reused by non-reentrant invocations
+	cs::vector args;
+	std::size_t depth = 0;
+
+	struct depth_guard {
+		std::size_t &depth;
+		explicit depth_guard(std::size_t &d) : depth(d)
 		{
-			std::unique_ptr<resource_holder> return_data(make_resource_holder(restype));
-			ffi_call(&_ffi_cif, target_func, return_data->get_ptr(), arg_data.get());
-			return return_data->get_var();
+			++depth;
 		}
-		else
+		~depth_guard()
 		{
-			ffi_call(&_ffi_cif, target_func, nullptr, arg_data.get());
-			return cs::null_pointer;
+			--depth;
+		}
+	};
+
+	static void entry(ffi_cif *, void *ret, void **native_args, void *userdata)
+	{
+		auto *self = static_cast<cffi_callback *>(userdata);
+		try {
+			if (cffi_async_worker)
+				throw cs::runtime_error("Callbacks can not be invoked from asynchronous calls.");
+			cs::vector local;
+			cs::vector &argv = self->depth == 0 ? self->args : local;
+			depth_guard guard(self->depth);
+			argv.resize(self->argtypes.size());
+			for (std::size_t i = 0; i < self->argtypes.size(); ++i) {
+				const cffi_param &param = self->argtypes[i];
+				if (param.layout) {
+					auto buff = std::make_shared<cffi_buffer>(param.layout->size());
+					std::memcpy(buff->data(), native_args[i], param.layout->size());
+					argv[i] = buff;
+				}
+				else
+					argv[i] = self->converters[i].load(native_args[i]);
+			}
+			cs::var val = self->func.call(argv);
+			if (self->restype.layout)
+				std::memcpy(ret, marshal_struct(*self->restype.layout, val), self->restype.layout->size());
+			else if (self->result.write_return != nullptr)
+				self->result.write_return(val, ret);
+		}
+		catch (...) {
+			if (!cffi_callback_error)
+				cffi_callback_error = std::current_exception();
+			if (self->restype.layout)
+				std::memset(ret, 0, self->restype.layout->size());
+			else if (self->restype.type != cffi_type::ffi_void)
+				std::memset(ret, 0, std::max(get_actual_type(self->restype.type)->size, sizeof(ffi_arg)));
 		}
 	}
+public:
+	cffi_callback(cs::callable fn, cffi_param rt, std::vector<cffi_param> ats) : func(std::move(fn)), restype(std::move(rt)), argtypes(std::move(ats))
+	{
+		if (!restype.layout && (restype.type == cffi_type::ffi_string || is_borrowed(restype.type)))
+			throw cs::lang_error("Callbacks can not return strings, use pointer instead.");
+		result = get_converter(restype.type);
+		converters.resize(argtypes.size());
+		ffi_types.resize(argtypes.size());
+		for (std::size_t i = 0; i < argtypes.size(); ++i) {
+			if (!argtypes[i].layout && argtypes[i].type == cffi_type::ffi_void)
+				throw cs::lang_error("Argument type can not be void.");
+			if (!argtypes[i].layout && argtypes[i].type == cffi_type::ffi_bytes)
+				throw cs::lang_error("Callbacks do not support bytes arguments.");
+			converters[i] = get_converter(argtypes[i].type);
+			ffi_types[i] = argtypes[i].get_type();
+		}
+		args.reserve(argtypes.size());
+		if (ffi_prep_cif(&cif, FFI_DEFAULT_ABI, argtypes.size(), restype.get_type(), ffi_types.data()) != FFI_OK)
+			throw cs::runtime_error("Init libffi CIF failed!");
+		closure = cffi_closure_pool::get_instance().acquire(&code);
+		if (ffi_prep_closure_loc(closure, &cif, &entry, this, code) != FFI_OK) {
+			cffi_closure_pool::get_instance().release(closure, code);
+			throw cs::runtime_error("Init libffi closure failed!");
+		}
+	}
+	cffi_callback(const cffi_callback &) = delete;
+	~cffi_callback()
+	{
+		cffi_closure_pool::get_instance().release(closure, code);
+	}
+	void *address() const noexcept
+	{
+		return code;
+	}
 };
 
+void *callback_address(const callback_type &cb)
+{
+	return cb->address();
+}
+
 struct dll_holder {
 	void *handle = nullptr;
+	// Resolved symbols, shared by every import from this library
+	std::unordered_map<std::string, void *> symbols;
+	std::string path;
 
-	dll_holder(std::string_view path)
+	dll_holder(std::string_view p) : path(p)
 	{
-		handle = cs::dll::open(path);
+		handle = cs::dll::open(p);
 	}
 
 	dll_holder(const dll_holder &) = delete;
@@ -362,14 +1309,87 @@ struct dll_holder {
 			cs::dll::close(handle);
 	}
 
-	void *get_address(std::string_view sym)
+	void *get_address(const std::string &sym)
+	{
+		auto it = symbols.find(sym);
+		if (it != symbols.end())
+			return it->second;
+		void *addr = cs::dll::find_symbol(handle, sym);
+		if (addr == nullptr)
+			throw cs::lang_error("Symbol \"" + sym + "\" not found.");
+		symbols.emplace(sym, addr);
+		return addr;
+	}
+
+	// Counters are per library and symbol, async imports are tracked apart
+	stats_type get_stats(const std::string &sym, bool async = false) const
 	{
-		return cs::dll::find_symbol(handle, sym);
+		return cffi_stats_registry::get_instance().get(path + ":" + sym + (async ? " (async)" : ""));
 	}
 };
 
 using dll_type = std::shared_ptr<dll_holder>;
 
+// One entry of an import table, typed entries carry a signature
+struct cffi_symbol_spec {
+	std::string name;
+	bool typed = false;
+	cffi_param restype;
+	std::vector<cffi_param> argtypes;
+
+	static cffi_symbol_spec from_var(const cs::var &val)
+	{
+		cffi_symbol_spec spec;
+		if (val.type() == typeid(cs::string)) {
+			spec.name = val.const_val<cs::string>();
+			return spec;
+		}
+		if (val.type() != typeid(cs::array))
+			throw cs::lang_error("Import table entry must be a name or {name, restype, argtypes}.");
+		const cs::array &entry = val.const_val<cs::array>();
+		if (entry.size() != 3 || entry[0].type() != typeid(cs::string) || entry[2].type() != typeid(cs::array))
+			throw cs::lang_error("Import table entry must be a name or {name, restype, argtypes}.");
+		spec.name = entry[0].const_val<cs::string>();
+		spec.typed = true;
+		spec.restype = cffi_param::from_var(entry[1]);
+		for (auto &it : entry[2].const_val<cs::array>())
+			spec.argtypes.emplace_back(cffi_param::from_var(it));
+		return spec;
+	}
+
+	cs::callable bind(const dll_type &dll) const
+	{
+		auto func = reinterpret_cast<void (*)()>(dll->get_address(name));
+		stats_type stats = dll->get_stats(name);
+		if (typed)
+			return cs::callable(cffi_callable(func, restype, argtypes, std::move(stats)));
+		else
+			return cs::callable(cffi_simple_callable(func, std::move(stats)));
+	}
+};
+
+// Resolves and prepares the function on its first call
+class cffi_lazy_callable final {
+	struct state_type {
+		dll_type dll;
+		cffi_symbol_spec spec;
+		std::unique_ptr<cs::callable> bound;
+	};
+	std::shared_ptr<state_type> state;
+public:
+	cffi_lazy_callable(dll_type dll, cffi_symbol_spec spec) : state(std::make_shared<state_type>())
+	{
+		state->dll = std::move(dll);
+		state->spec = std::move(spec);
+	}
+	cs::var operator()(cs::vector &args) const
+	{
+		if (!state->bound)
+			state->bound.reset(new cs::callable(state->spec.bind(state->dll)));
+		return state->bound->call(args);
+	}
+};
+
 CNI_ROOT_NAMESPACE {
 	using namespace cs;
 
@@ -380,22 +1400,192 @@ CNI_ROOT_NAMESPACE {
 
 	CNI(import_lib)
 
+	callback_type make_callback(const callable &func, const var &restype, const array &ats)
+	{
+		std::vector<cffi_param> argtypes;
+		for (auto &it : ats)
+			argtypes.emplace_back(cffi_param::from_var(it));
+		return std::make_shared<cffi_callback>(func, cffi_param::from_var(restype), std::move(argtypes));
+	}
+
+	CNI(make_callback)
+
+	void enable_stats(bool value)
+	{
+		cffi_profiling = value;
+	}
+
+	CNI(enable_stats)
+
+	var stats()
+	{
+		static const char *phase_names[] = {"marshal", "call", "unmarshal"};
+		var ret = var::make<hash_map>();
+		hash_map &result = ret.val<hash_map>();
+		cffi_stats_registry::get_instance().for_each([&result](const std::string &name, const cffi_func_stats &st) {
+			if (st.calls == 0)
+				return;
+			var entry = var::make<hash_map>();
+			hash_map &map = entry.val<hash_map>();
+			map.emplace(var::make<string>("calls"), var::make<numeric>(st.calls.load()));
+			for (std::size_t i = 0; i < phase_count; ++i) {
+				map.emplace(var::make<string>(std::string(phase_names[i]) + "_ns"), var::make<numeric>(st.total_ns[i].load()));
+				map.emplace(var::make<string>(std::string(phase_names[i]) + "_max_ns"), var::make<numeric>(st.max_ns[i].load()));
+			}
+			var histogram = var::make<array>();
+			for (auto &it : st.histogram)
+				histogram.val<array>().push_back(var::make<numeric>(it.load()));
+			map.emplace(var::make<string>("histogram"), histogram);
+			result.emplace(var::make<string>(name), entry);
+		});
+		return ret;
+	}
+
+	CNI(stats)
+
+	void reset_stats()
+	{
+		cffi_stats_registry::get_instance().for_each([](const std::string &, cffi_func_stats &st) {
+			st.reset();
+		});
+	}
+
+	CNI(reset_stats)
+
+	void set_async_workers(std::size_t count)
+	{
+		cffi_worker_pool::get_instance().set_max_workers(count);
+	}
+
+	CNI(set_async_workers)
+
+	CNI_NAMESPACE(future)
+	{
+		bool ready(const future_type &fut) {
+			return fut->ready();
+		}
+
+		CNI(ready)
+
+		void wait(const future_type &fut) {
+			fut->wait();
+		}
+
+		CNI(wait)
+
+		bool wait_for(const future_type &fut, std::size_t ms) {
+			return fut->wait_for(ms);
+		}
+
+		CNI(wait_for)
+
+		var get(const future_type &fut) {
+			return fut->get();
+		}
+
+		CNI(get)
+	}
+
+	CNI_NAMESPACE(callback)
+	{
+		void *address(const callback_type &cb) {
+			return cb->address();
+		}
+
+		CNI(address)
+	}
+
 	CNI_NAMESPACE(lib)
 	{
 		callable import_func(const dll_type &dll, const std::string &name) {
-			return callable(cffi_simple_callable((void(*)())dll->get_address(name)));
+			return callable(cffi_simple_callable((void(*)())dll->get_address(name), dll->get_stats(name)));
 		}
 
 		CNI(import_func)
 
-		callable import_func_s(const dll_type &dll, const std::string &name, cffi_type restype, const array &ats) {
-			std::vector<cffi_type> argtypes;
+		callable import_func_s(const dll_type &dll, const std::string &name, const var &restype, const array &ats) {
+			std::vector<cffi_param> argtypes;
 			for (auto &it : ats)
-				argtypes.emplace_back(it.const_val<cffi_type>());
-			return callable(cffi_callable((void(*)())dll->get_address(name), restype, std::move(argtypes)));
+				argtypes.emplace_back(cffi_param::from_var(it));
+			return callable(cffi_callable((void(*)())dll->get_address(name), cffi_param::from_var(restype), std::move(argtypes), dll->get_stats(name)));
 		}
 
 		CNI(import_func_s)
+
+		callable import_func_async(const dll_type &dll, const std::string &name, const var &restype, const array &ats) {
+			std::vector<cffi_param> argtypes;
+			for (auto &it : ats)
+				argtypes.emplace_back(cffi_param::from_var(it));
+			return callable(cffi_async_callable((void(*)())dll->get_address(name), cffi_param::from_var(restype), std::move(argtypes), dll->get_stats(name, true)));
+		}
+
+		CNI(import_func_async)
+
+		var import_table(const dll_type &dll, const array &table) {
+			namespace_t ns = make_shared_namespace<name_space>();
+			for (auto &it : table) {
+				cffi_symbol_spec spec = cffi_symbol_spec::from_var(it);
+				ns->add_var(spec.name, spec.bind(dll));
+			}
+			return var::make<namespace_t>(ns);
+		}
+
+		CNI(import_table)
+
+		var import_table_lazy(const dll_type &dll, const array &table) {
+			namespace_t ns = make_shared_namespace<name_space>();
+			for (auto &it : table) {
+				cffi_symbol_spec spec = cffi_symbol_spec::from_var(it);
+				std::string name = spec.name;
+				ns->add_var(name, callable(cffi_lazy_callable(dll, std::move(spec))));
+			}
+			return var::make<namespace_t>(ns);
+		}
+
+		CNI(import_table_lazy)
+
+		array call_batch(const callable &func, const array &rows) {
+			array results(rows.size());
+			vector args;
+			for (std::size_t i = 0; i < rows.size(); ++i) {
+				const var &row = rows[i];
+				if (row.type() == typeid(array)) {
+					const array &data = row.const_val<array>();
+					args.assign(data.begin(), data.end());
+				}
+				else
+					args.assign(1, row);
+				results[i] = func.call(args);
+			}
+			return results;
+		}
+
+		CNI(call_batch)
+
+		array call_batch_columns(const callable &func, const array &columns) {
+			std::vector<const array *> cols;
+			cols.reserve(columns.size());
+			for (auto &it : columns) {
+				if (it.type() != typeid(array))
+					throw lang_error("Column must be an array.");
+				cols.push_back(&it.const_val<array>());
+			}
+			std::size_t count = cols.empty() ? 0 : cols.front()->size();
+			for (auto col : cols) {
+				if (col->size() != count)
+					throw lang_error("Unmatched column size.");
+			}
+			array results(count);
+			vector args(cols.size());
+			for (std::size_t i = 0; i < count; ++i) {
+				for (std::size_t j = 0; j < cols.size(); ++j)
+					args[j] = (*cols[j])[i];
+				results[i] = func.call(args);
+			}
+			return results;
+		}
+
+		CNI(call_batch_columns)
 	}
 
 	CNI_NAMESPACE(utils)
@@ -417,10 +1607,208 @@ CNI_ROOT_NAMESPACE {
 		}
 
 		CNI(is_nullptr)
+
+		var cif_cache_stats() {
+			var ret = var::make<hash_map>();
+			hash_map &map = ret.val<hash_map>();
+			map.emplace(var::make<string>("hits"), var::make<numeric>(cffi_cache_stats.hits));
+			map.emplace(var::make<string>("misses"), var::make<numeric>(cffi_cache_stats.misses));
+			return ret;
+		}
+
+		CNI(cif_cache_stats)
+
+		void reset_cif_cache_stats() {
+			cffi_cache_stats = cffi_cache_stats_type();
+		}
+
+		CNI(reset_cif_cache_stats)
+	}
+
+	CNI_NAMESPACE(buffer)
+	{
+		buffer_type create(std::size_t size) {
+			return std::make_shared<cffi_buffer>(size);
+		}
+
+		CNI(create)
+
+		buffer_type from_string(const std::string &str) {
+			auto buff = std::make_shared<cffi_buffer>(str.size());
+			std::memcpy(buff->data(), str.data(), str.size());
+			return buff;
+		}
+
+		CNI(from_string)
+
+		string to_string(const buffer_type &buff) {
+			return string(reinterpret_cast<const char *>(buff->data()), buff->size());
+		}
+
+		CNI(to_string)
+
+		numeric size(const buffer_type &buff) {
+			return buff->size();
+		}
+
+		CNI(size)
+
+		void *address(const buffer_type &buff) {
+			return buff->data();
+		}
+
+		CNI(address)
+
+		buffer_type slice(const buffer_type &buff, std::size_t offset, std::size_t size) {
+			return std::make_shared<cffi_buffer>(*buff, offset, size);
+		}
+
+		CNI(slice)
+
+		void fill(buffer_type &buff, std::size_t value) {
+			std::memset(buff->data(), static_cast<unsigned char>(value), buff->size());
+		}
+
+		CNI(fill)
+
+		void copy(buffer_type &dst, std::size_t dst_offset, const buffer_type &src, std::size_t src_offset, std::size_t size) {
+			dst->check_range(dst_offset, size);
+			src->check_range(src_offset, size);
+			std::memmove(dst->data() + dst_offset, src->data() + src_offset, size);
+		}
+
+		CNI(copy)
+
+		CNI_V(get_u8,  &buffer_get<std::uint8_t>)
+		CNI_V(get_u16, &buffer_get<std::uint16_t>)
+		CNI_V(get_u32, &buffer_get<std::uint32_t>)
+		CNI_V(get_u64, &buffer_get<std::uint64_t>)
+		CNI_V(get_i8,  &buffer_get<std::int8_t>)
+		CNI_V(get_i16, &buffer_get<std::int16_t>)
+		CNI_V(get_i32, &buffer_get<std::int32_t>)
+		CNI_V(get_i64, &buffer_get<std::int64_t>)
+		CNI_V(get_f32, &buffer_get<float>)
+		CNI_V(get_f64, &buffer_get<double>)
+		CNI_V(set_u8,  &buffer_set<std::uint8_t>)
+		CNI_V(set_u16, &buffer_set<std::uint16_t>)
+		CNI_V(set_u32, &buffer_set<std::uint32_t>)
+		CNI_V(set_u64, &buffer_set<std::uint64_t>)
+		CNI_V(set_i8,  &buffer_set<std::int8_t>)
+		CNI_V(set_i16, &buffer_set<std::int16_t>)
+		CNI_V(set_i32, &buffer_set<std::int32_t>)
+		CNI_V(set_i64, &buffer_set<std::int64_t>)
+		CNI_V(set_f32, &buffer_set<float>)
+		CNI_V(set_f64, &buffer_set<double>)
+	}
+
+	CNI_NAMESPACE(layout)
+	{
+		numeric size(const struct_type &st) {
+			return st->size();
+		}
+
+		CNI(size)
+
+		numeric alignment(const struct_type &st) {
+			return st->alignment();
+		}
+
+		CNI(alignment)
+
+		numeric offset_of(const struct_type &st, const std::string &field) {
+			return st->offset_of(st->index_of(field));
+		}
+
+		CNI(offset_of)
+
+		buffer_type make_array(const struct_type &st, std::size_t count) {
+			return std::make_shared<cffi_buffer>(st->size() * count);
+		}
+
+		CNI(make_array)
+
+		numeric count(const struct_type &st, const buffer_type &buff) {
+			return st->count_of(buff);
+		}
+
+		CNI(count)
+
+		var get(const struct_type &st, const buffer_type &buff, std::size_t index, const std::string &field) {
+			return st->read(st->record_at(buff, index), st->index_of(field));
+		}
+
+		CNI(get)
+
+		void set(const struct_type &st, buffer_type &buff, std::size_t index, const std::string &field, const var &val) {
+			st->write(st->record_at(buff, index), st->index_of(field), val);
+		}
+
+		CNI(set)
+
+		array get_column(const struct_type &st, const buffer_type &buff, const std::string &field) {
+			const std::size_t idx = st->index_of(field), count = st->count_of(buff);
+			array column(count);
+			for (std::size_t i = 0; i < count; ++i)
+				column[i] = st->read(buff->data() + i * st->size(), idx);
+			return column;
+		}
+
+		CNI(get_column)
+
+		void set_column(const struct_type &st, buffer_type &buff, const std::string &field, const array &column) {
+			const std::size_t idx = st->index_of(field);
+			if (column.size() > st->count_of(buff))
+				throw lang_error("Struct array access out of range.");
+			for (std::size_t i = 0; i < column.size(); ++i)
+				st->write(buff->data() + i * st->size(), idx, column[i]);
+		}
+
+		CNI(set_column)
+
+		buffer_type pack(const struct_type &st, const hash_map &values) {
+			auto buff = std::make_shared<cffi_buffer>(st->size());
+			for (auto &it : values) {
+				if (it.first.type() != typeid(string))
+					throw lang_error("Field name must be string.");
+				st->write(buff->data(), st->index_of(it.first.const_val<string>()), it.second);
+			}
+			return buff;
+		}
+
+		CNI(pack)
+
+		var unpack(const struct_type &st, const buffer_type &buff, std::size_t index) {
+			const unsigned char *record = st->record_at(buff, index);
+			var ret = var::make<hash_map>();
+			hash_map &map = ret.val<hash_map>();
+			for (std::size_t i = 0; i < st->field_count(); ++i)
+				map.emplace(var::make<string>(st->field_name(i)), st->read(record, i));
+			return ret;
+		}
+
+		CNI(unpack)
 	}
 
 	CNI_NAMESPACE(types)
 	{
+		struct_type make_struct(const array &names, const array &fields) {
+			std::vector<std::string> field_names;
+			std::vector<cffi_type> field_types;
+			for (auto &it : names) {
+				if (it.type() != typeid(string))
+					throw lang_error("Field name must be string.");
+				field_names.emplace_back(it.const_val<string>());
+			}
+			for (auto &it : fields) {
+				if (it.type() != typeid(cffi_type))
+					throw lang_error("Field type must be a scalar cffi type.");
+				field_types.emplace_back(it.const_val<cffi_type>());
+			}
+			return std::make_shared<cffi_struct>(std::move(field_names), std::move(field_types));
+		}
+
+		CNI(make_struct)
+
 		CNI_VALUE(void,    cffi_type::ffi_void)
 		CNI_VALUE(pointer, cffi_type::ffi_pointer)
 		CNI_VALUE(double,  cffi_type::ffi_double)
@@ -434,7 +1822,13 @@ CNI_ROOT_NAMESPACE {
 		CNI_VALUE(uint,    cffi_type::ffi_uint)
 		CNI_VALUE(ulong,   cffi_type::ffi_ulong)
 		CNI_VALUE(string,  cffi_type::ffi_string)
+		CNI_VALUE(string_ref, cffi_type::ffi_string_ref)
+		CNI_VALUE(bytes,   cffi_type::ffi_bytes)
 	}
 }
 
-CNI_ENABLE_TYPE_EXT(lib, dll_type)
\ No newline at end of file
+CNI_ENABLE_TYPE_EXT(lib, dll_type)
+CNI_ENABLE_TYPE_EXT(buffer, buffer_type)
+CNI_ENABLE_TYPE_EXT(layout, struct_type)
+CNI_ENABLE_TYPE_EXT(callback, callback_type)
+CNI_ENABLE_TYPE_EXT(future, future_type)
\ No newline at end of file
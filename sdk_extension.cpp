@@ -2,6 +2,16 @@
 #include <covscript/cni.hpp>
 #include <covscript/dll.hpp>
 #include <iostream>
+#include <deque>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <functional>
+#include <algorithm>
+#include <cctype>
+#include <sstream>
+#include <unordered_set>
+#include <typeindex>
 
 #ifdef COVSCRIPT_PLATFORM_WIN32
 
@@ -33,6 +43,12 @@ void activate_sigint_handler()
 
 #include <signal.h>
 #include <unistd.h>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
 
 void signal_handler(int sig)
 {
@@ -51,11 +67,139 @@ void activate_sigint_handler()
 
 #endif
 
-static bool signal_handler_installed = false;
+// Listeners throw on the thread that raised the event. An exit() inside a
+// REPL ends that REPL and is recorded on it; only code running outside any
+// REPL still sets the process exit code.
+static std::once_flag signal_handler_installed;
+thread_local std::size_t repl_depth = 0;
+thread_local int repl_exit_code = 0;
+
+class repl_instance;
+
+// Parsed source bound to the context whose compiler produced it. Entries
+// that failed to parse as an expression are cached too, so exec does not
+// retry them on every call.
+struct repl_code final {
+	std::weak_ptr<cs::context_type> owner;
+	std::string source;
+	bool expression = false;
+	cs::expression_t tree;
+};
+
+using repl_code_t = std::shared_ptr<repl_code>;
 
 class repl_instance final {
 	cs::context_t context;
 	bool exit_flag = false;
+	int exit_code = 0;
+
+	// Bounded LRU of compiled snippets keyed by the hash of their source
+	static constexpr std::size_t code_cache_size = 256;
+	std::list<repl_code_t> code_lru;
+	std::unordered_map<std::size_t, std::list<repl_code_t>::iterator> code_cache;
+
+	repl_code_t find_cached(const std::string &code)
+	{
+		auto it = code_cache.find(std::hash<std::string> {}(code));
+		if (it == code_cache.end() || (*it->second)->source != code)
+			return nullptr;
+		code_lru.splice(code_lru.begin(), code_lru, it->second);
+		return *it->second;
+	}
+
+	void add_cached(const repl_code_t &code)
+	{
+		std::size_t key = std::hash<std::string> {}(code->source);
+		auto it = code_cache.find(key);
+		if (it != code_cache.end())
+			code_lru.erase(it->second);
+		else if (code_lru.size() >= code_cache_size) {
+			code_cache.erase(std::hash<std::string> {}(code_lru.back()->source));
+			code_lru.pop_back();
+		}
+		code_lru.push_front(code);
+		code_cache[key] = code_lru.begin();
+	}
+
+	// Block nesting comes from the REPL itself. Raw @begin/@end input is a
+	// directive handled before any parsing, so it is followed here.
+	bool raw_block = false;
+
+	// Hashes of top-level lines seen once. A line is only parsed for the
+	// cache when it comes back, so one-off lines cost nothing extra.
+	static constexpr std::size_t sighting_size = 1024;
+	std::unordered_set<std::size_t> sighted;
+	std::deque<std::size_t> sighting_order;
+
+	bool sighted_before(std::size_t key)
+	{
+		if (sighted.count(key) != 0)
+			return true;
+		if (sighting_order.size() >= sighting_size) {
+			sighted.erase(sighting_order.front());
+			sighting_order.pop_front();
+		}
+		sighted.insert(key);
+		sighting_order.push_back(key);
+		return false;
+	}
+
+	void track_raw_block(const std::string &code)
+	{
+		std::size_t start = code.find_first_not_of(" \t"), end = code.find_last_not_of(" \t\r");
+		if (start == std::string::npos)
+			return;
+		std::string line = code.substr(start, end - start + 1);
+		if (!raw_block && line == "@begin")
+			raw_block = true;
+		else if (raw_block && line == "@end")
+			raw_block = false;
+	}
+
+	repl_code_t parse(const std::string &code)
+	{
+		repl_code_t ret = std::make_shared<repl_code>();
+		ret->owner = context;
+		ret->source = code;
+		std::deque<char> buff(code.begin(), code.end());
+		context->compiler->build_expr(buff, ret->tree);
+		ret->expression = true;
+		return ret;
+	}
+
+	// Runs func with the REPL's exit and interrupt handling, returns false when interrupted or exited
+	template <typename FuncT>
+	bool guarded(FuncT &&func)
+	{
+		struct depth_guard {
+			depth_guard()
+			{
+				++repl_depth;
+			}
+			~depth_guard()
+			{
+				--repl_depth;
+			}
+		} depth;
+		try {
+			func();
+			return true;
+		}
+		catch (const std::exception &e) {
+			if (std::strstr(e.what(), "CS_SIGINT") != nullptr)
+				activate_sigint_handler();
+			else if (std::strstr(e.what(), "CS_EXIT") != nullptr) {
+				exit_flag = true;
+				exit_code = repl_exit_code;
+			}
+			else
+				throw cs::lang_error(e.what());
+		}
+		catch (...) {
+			throw cs::lang_error("Uncaught exception: Unknown exception");
+		}
+		return false;
+	}
 
 public:
 	cs::repl repl_impl;
@@ -64,10 +208,13 @@ public:
 		: context(cs::create_context(args)),
 		  repl_impl(context)
 	{
-		if (!signal_handler_installed) {
+		std::call_once(signal_handler_installed, [] {
 			activate_sigint_handler();
 			cs::current_process->on_process_exit.add_listener([](void *code) -> bool {
-				cs::current_process->exit_code = *static_cast<int *>(code);
+				if (repl_depth > 0)
+					repl_exit_code = *static_cast<int *>(code);
+				else
+					cs::current_process->exit_code = *static_cast<int *>(code);
 				throw cs::fatal_error("CS_EXIT");
 			});
 			cs::current_process->on_process_sigint.add_listener([](void *) -> bool {
@@ -77,74 +224,1212 @@ public:
 				std::cin.clear();
 				return false;
 			});
-			signal_handler_installed = true;
+		});
+	}
+
+	~repl_instance() = default;
+
+	bool has_exited() const
+	{
+		return exit_flag;
+	}
+
+	int get_exit_code() const
+	{
+		return exit_code;
+	}
+
+	cs::var readline()
+	{
+		try {
+			std::string line;
+#ifdef COVSCRIPT_PLATFORM_WIN32
+			// Workaround: https://stackoverflow.com/a/26763490
+			while (true) {
+				cs::current_process->poll_event();
+				std::getline(std::cin, line);
+				if (std::cin) break;
+			}
+#else
+			if (!std::cin) {
+				int code = 0;
+				cs::process_context::on_process_exit_default_handler(&code);
+			}
+			std::getline(std::cin, line);
+			cs::current_process->poll_event();
+#endif
+			return std::move(line);
+		}
+		catch (const std::exception &e) {
+			if (std::strstr(e.what(), "CS_SIGINT") != nullptr)
+				activate_sigint_handler();
+			else if (std::strstr(e.what(), "CS_EXIT") != nullptr)
+				exit_flag = true;
+			else
+				throw cs::lang_error(e.what());
+		}
+		catch (...) {
+			throw cs::lang_error("Uncaught exception: Unknown exception");
+		}
+		return cs::null_pointer;
+	}
+
+	// Top-level expression lines seen more than once run from the source
+	// cache; everything else goes through the REPL as typed
+	bool exec(const std::string &code)
+	{
+		bool top_level = !raw_block && repl_impl.get_level() == 0;
+		track_raw_block(code);
+		std::size_t start = code.find_first_not_of(" \t");
+		if (top_level && start != std::string::npos && code[start] != '#' && code[start] != '@') {
+			repl_code_t cached = find_cached(code);
+			if (!cached && sighted_before(std::hash<std::string> {}(code))) {
+				try {
+					cached = parse(code);
+				}
+				catch (const std::exception &) {
+					// Statements are not expressions, remember that and let the REPL run them
+					cached = std::make_shared<repl_code>();
+					cached->owner = context;
+					cached->source = code;
+				}
+				add_cached(cached);
+			}
+			if (cached && cached->expression) {
+				cs::var result;
+				bool finished = guarded([&] {
+					result = context->instance->parse_expr(cached->tree.root());
+				});
+				if (finished && repl_impl.echo)
+					std::cout << result.to_string() << std::endl;
+				return finished;
+			}
+		}
+		return guarded([&] {
+			repl_impl.exec(code);
+		});
+	}
+
+	void reset()
+	{
+		repl_impl.reset_status();
+		raw_block = false;
+	}
+
+	repl_code_t compile(const std::string &code)
+	{
+		repl_code_t cached = find_cached(code);
+		if (cached && cached->expression)
+			return cached;
+		repl_code_t ret;
+		try {
+			ret = parse(code);
+		}
+		catch (const std::exception &e) {
+			throw cs::lang_error(e.what());
+		}
+		add_cached(ret);
+		return ret;
+	}
+
+	cs::var run(const repl_code_t &code)
+	{
+		if (!code->expression || code->owner.lock() != context)
+			throw cs::lang_error("Compiled code belongs to another REPL.");
+		cs::var result = cs::null_pointer;
+		guarded([&] {
+			result = context->instance->parse_expr(code->tree.root());
+		});
+		return result;
+	}
+};
+
+using repl_instance_t = std::shared_ptr<repl_instance>;
+
+// Keeps pre-initialized REPL instances ready to hand out. The snapshot is the
+// warm-up code (usually imports) every instance replays before it is pooled,
+// so acquire only pays for popping a ready instance.
+// Instances are never taken back: one that was handed out carries user state
+// and goes away with the caller's last reference. Only fill() restores the
+// fast path; once the ready instances run out, acquire creates a context and
+// replays the snapshot inline.
+class repl_pool final {
+	cs::array args;
+	std::vector<std::string> snapshot;
+	std::deque<repl_instance_t> ready;
+	std::size_t capacity;
+
+	repl_instance_t spawn() const
+	{
+		repl_instance_t repl = std::make_shared<repl_instance>(args);
+		bool echo = repl->repl_impl.echo;
+		repl->repl_impl.echo = false;
+		for (auto &code : snapshot) {
+			if (!repl->exec(code))
+				throw cs::lang_error("REPL pool snapshot exited while warming up.");
+		}
+		repl->reset();
+		repl->repl_impl.echo = echo;
+		return repl;
+	}
+
+public:
+	repl_pool(const cs::array &init_args, std::size_t size) : args(init_args), capacity(size) {}
+
+	// Replaces the warm-up code and rebuilds every pooled instance from it
+	void set_snapshot(const cs::array &codes)
+	{
+		std::vector<std::string> lines;
+		for (auto &it : codes) {
+			if (it.type() != typeid(cs::string))
+				throw cs::lang_error("REPL pool snapshot must be an array of strings.");
+			lines.push_back(it.const_val<cs::string>());
+		}
+		snapshot.swap(lines);
+		ready.clear();
+		fill();
+	}
+
+	// The expensive part of the pool: call it at idle time between requests
+	void fill()
+	{
+		while (ready.size() < capacity)
+			ready.push_back(spawn());
+	}
+
+	repl_instance_t acquire()
+	{
+		repl_instance_t repl;
+		if (ready.empty())
+			repl = spawn();
+		else {
+			repl = std::move(ready.front());
+			ready.pop_front();
+		}
+		return repl;
+	}
+
+	std::size_t size() const
+	{
+		return ready.size();
+	}
+
+	std::size_t get_capacity() const
+	{
+		return capacity;
+	}
+};
+
+using repl_pool_t = std::shared_ptr<repl_pool>;
+
+// Plain value passed between REPLs, script objects stay in their own context
+struct repl_message final {
+	enum class kind {
+		null, boolean, number, string
+	} type = kind::null;
+	bool boolean = false;
+	cs::numeric number;
+	std::string string;
+
+	static repl_message from_var(const cs::var &val)
+	{
+		repl_message msg;
+		if (val.type() == typeid(cs::boolean)) {
+			msg.type = kind::boolean;
+			msg.boolean = val.const_val<cs::boolean>();
+		}
+		else if (val.type() == typeid(cs::numeric)) {
+			msg.type = kind::number;
+			msg.number = val.const_val<cs::numeric>();
+		}
+		else if (val.type() == typeid(cs::string)) {
+			msg.type = kind::string;
+			msg.string = val.const_val<cs::string>();
+		}
+		else if (val != cs::null_pointer)
+			throw cs::lang_error("Only null, boolean, number and string values can be passed between REPLs.");
+		return msg;
+	}
+
+	cs::var to_var() const
+	{
+		switch (type) {
+		case kind::boolean:
+			return cs::var::make<cs::boolean>(boolean);
+		case kind::number:
+			return cs::var::make<cs::numeric>(number);
+		case kind::string:
+			return cs::var::make<cs::string>(string);
+		default:
+			return cs::null_pointer;
+		}
+	}
+};
+
+// Bounded FIFO of messages. Everything runs on the caller's thread, so an
+// operation that would have to wait for another party fails instead.
+class repl_channel final {
+	std::deque<repl_message> queue;
+	std::size_t limit;
+
+public:
+	explicit repl_channel(std::size_t capacity) : limit(capacity) {}
+
+	bool try_push(repl_message &msg)
+	{
+		if (queue.size() >= limit)
+			return false;
+		queue.push_back(std::move(msg));
+		return true;
+	}
+
+	bool try_pop(repl_message &msg)
+	{
+		if (queue.empty())
+			return false;
+		msg = std::move(queue.front());
+		queue.pop_front();
+		return true;
+	}
+
+	void push(repl_message &msg)
+	{
+		if (!try_push(msg))
+			throw cs::lang_error("Channel is full.");
+	}
+
+	repl_message pop()
+	{
+		repl_message msg;
+		if (!try_pop(msg))
+			throw cs::lang_error("Channel is empty.");
+		return msg;
+	}
+
+	std::size_t size() const
+	{
+		return queue.size();
+	}
+
+	std::size_t capacity() const
+	{
+		return limit;
+	}
+};
+
+using repl_channel_t = std::shared_ptr<repl_channel>;
+
+class repl_queue;
+
+// Result slot of a queued task, settled when the queue runs the task
+struct repl_task_state final {
+	bool done = false;
+	repl_message value;
+	std::exception_ptr error;
+};
+
+class repl_future final {
+	std::shared_ptr<repl_task_state> state;
+	std::weak_ptr<repl_queue> owner;
+
+public:
+	repl_future(std::shared_ptr<repl_task_state> s, std::weak_ptr<repl_queue> q) : state(std::move(s)), owner(std::move(q)) {}
+
+	bool ready() const
+	{
+		return state->done;
+	}
+
+	// Runs the owning queue up to and including this task
+	void wait() const;
+
+	cs::var get() const
+	{
+		wait();
+		if (state->error)
+			std::rethrow_exception(state->error);
+		return state->value.to_var();
+	}
+};
+
+using repl_future_t = std::shared_ptr<repl_future>;
+
+// REPL with a queue of deferred tasks. Nothing runs in the background: the
+// runtime keeps process-wide state and offers no per-thread contexts, so
+// tasks run in order on the caller's thread when it calls run_one or run_all,
+// or waits on one of the futures.
+class repl_queue final : public std::enable_shared_from_this<repl_queue> {
+	using job_type = std::function<repl_message(repl_instance &)>;
+	struct task {
+		job_type job;
+		std::shared_ptr<repl_task_state> state;
+	};
+
+	repl_instance repl;
+	std::deque<task> tasks;
+	bool running = false;
+
+public:
+	explicit repl_queue(const cs::array &args) : repl(args)
+	{
+		repl.repl_impl.echo = false;
+	}
+
+	repl_future_t post(job_type job)
+	{
+		auto state = std::make_shared<repl_task_state>();
+		tasks.push_back(task {std::move(job), state});
+		return std::make_shared<repl_future>(state, shared_from_this());
+	}
+
+	bool run_one()
+	{
+		if (tasks.empty())
+			return false;
+		if (running)
+			throw cs::lang_error("REPL queue can not run tasks from inside one of its own tasks.");
+		task current = std::move(tasks.front());
+		tasks.pop_front();
+		running = true;
+		try {
+			current.state->value = current.job(repl);
+		}
+		catch (...) {
+			current.state->error = std::current_exception();
+		}
+		running = false;
+		current.state->done = true;
+		return true;
+	}
+
+	std::size_t run_all()
+	{
+		std::size_t count = 0;
+		while (run_one())
+			++count;
+		return count;
+	}
+
+	// Settles every queued task with an error without running it
+	void cancel()
+	{
+		std::deque<task> cancelled;
+		cancelled.swap(tasks);
+		for (auto &it : cancelled) {
+			it.state->error = std::make_exception_ptr(cs::lang_error("REPL queue task cancelled."));
+			it.state->done = true;
+		}
+	}
+
+	std::size_t pending() const
+	{
+		return tasks.size();
+	}
+
+	bool has_exited() const
+	{
+		return repl.has_exited();
+	}
+};
+
+using repl_queue_t = std::shared_ptr<repl_queue>;
+
+void repl_future::wait() const
+{
+	if (state->done)
+		return;
+	repl_queue_t queue = owner.lock();
+	while (!state->done && queue && queue->run_one());
+	if (!state->done)
+		throw cs::lang_error("REPL queue was destroyed before the task ran.");
+}
+
+// Trie over symbol names, children are kept sorted in small vectors
+class symbol_trie final {
+	static constexpr std::uint32_t npos = 0xFFFFFFFF;
+	struct node {
+		std::vector<std::pair<char, std::uint32_t>> children;
+		std::uint32_t symbol = npos;
+	};
+	std::vector<node> nodes {node()};
+	std::vector<std::string> names;
+
+	std::uint32_t child(std::uint32_t parent, char ch) const
+	{
+		auto &children = nodes[parent].children;
+		auto it = std::lower_bound(children.begin(), children.end(), ch, [](const std::pair<char, std::uint32_t> &lhs, char rhs) {
+			return lhs.first < rhs;
+		});
+		return it != children.end() && it->first == ch ? it->second : npos;
+	}
+
+	std::uint32_t find_node(const std::string &prefix) const
+	{
+		std::uint32_t cur = 0;
+		for (std::size_t i = 0; i < prefix.size() && cur != npos; ++i)
+			cur = child(cur, prefix[i]);
+		return cur;
+	}
+
+public:
+	bool insert(const std::string &name)
+	{
+		std::uint32_t cur = 0;
+		for (char ch : name) {
+			std::uint32_t next = child(cur, ch);
+			if (next == npos) {
+				next = static_cast<std::uint32_t>(nodes.size());
+				nodes.emplace_back();
+				auto &children = nodes[cur].children;
+				auto it = std::lower_bound(children.begin(), children.end(), ch, [](const std::pair<char, std::uint32_t> &lhs, char rhs) {
+					return lhs.first < rhs;
+				});
+				children.emplace(it, ch, next);
+			}
+			cur = next;
+		}
+		if (nodes[cur].symbol != npos)
+			return false;
+		nodes[cur].symbol = static_cast<std::uint32_t>(names.size());
+		names.push_back(name);
+		return true;
+	}
+
+	bool contains(const std::string &name) const
+	{
+		std::uint32_t cur = find_node(name);
+		return cur != npos && nodes[cur].symbol != npos;
+	}
+
+	// Breadth first, so shorter completions come before longer ones
+	std::vector<std::string> prefix(const std::string &pre, std::size_t limit) const
+	{
+		std::vector<std::string> ret;
+		std::uint32_t start = find_node(pre);
+		if (start == npos)
+			return ret;
+		std::deque<std::uint32_t> queue {start};
+		while (!queue.empty() && ret.size() < limit) {
+			const node &cur = nodes[queue.front()];
+			queue.pop_front();
+			if (cur.symbol != npos)
+				ret.push_back(names[cur.symbol]);
+			for (auto &it : cur.children)
+				queue.push_back(it.second);
+		}
+		return ret;
+	}
+
+	// Exact and prefix matches rank above any subsequence-only match
+	static constexpr int prefix_bonus = 1 << 20;
+	static constexpr int exact_bonus = 1 << 21;
+
+	// Case-insensitive subsequence match, rewards consecutive and word-start hits
+	static int fuzzy_score(const std::string &pattern, const std::string &name)
+	{
+		int score = 0, streak = 0;
+		std::size_t pos = 0;
+		for (std::size_t i = 0; i < name.size() && pos < pattern.size(); ++i) {
+			if (std::tolower(static_cast<unsigned char>(name[i])) != std::tolower(static_cast<unsigned char>(pattern[pos]))) {
+				streak = 0;
+				continue;
+			}
+			score += 1 + 2 * streak++;
+			if (i == 0 || name[i - 1] == '_' || (std::isupper(static_cast<unsigned char>(name[i])) && std::islower(static_cast<unsigned char>(name[i - 1]))))
+				score += 3;
+			++pos;
+		}
+		if (pos != pattern.size())
+			return -1;
+		bool is_prefix = true;
+		for (std::size_t i = 0; is_prefix && i < pattern.size(); ++i)
+			is_prefix = std::tolower(static_cast<unsigned char>(name[i])) == std::tolower(static_cast<unsigned char>(pattern[i]));
+		if (is_prefix)
+			score += name.size() == pattern.size() ? exact_bonus : prefix_bonus;
+		return score;
+	}
+
+	// Linear scan over every name, the trie only serves prefix lookups
+	std::vector<std::string> fuzzy(const std::string &pattern, std::size_t limit) const
+	{
+		std::vector<std::pair<int, std::uint32_t>> hits;
+		for (std::size_t i = 0; i < names.size(); ++i) {
+			int score = fuzzy_score(pattern, names[i]);
+			if (score >= 0)
+				hits.emplace_back(score, static_cast<std::uint32_t>(i));
+		}
+		auto better = [this](const std::pair<int, std::uint32_t> &lhs, const std::pair<int, std::uint32_t> &rhs) {
+			if (lhs.first != rhs.first)
+				return lhs.first > rhs.first;
+			const std::string &a = names[lhs.second], &b = names[rhs.second];
+			return a.size() != b.size() ? a.size() < b.size() : a < b;
+		};
+		std::size_t count = std::min(limit, hits.size());
+		std::partial_sort(hits.begin(), hits.begin() + count, hits.end(), better);
+		std::vector<std::string> ret;
+		for (std::size_t i = 0; i < count; ++i)
+			ret.push_back(names[hits[i].second]);
+		return ret;
+	}
+
+	std::size_t size() const
+	{
+		return names.size();
+	}
+};
+
+// Symbol index bound to one domain. Domains only ever gain symbols, so a
+// refresh walks the names and inserts the unseen ones; the version only
+// moves when something was added.
+class symbol_index final {
+	std::function<const cs::domain_type &()> domain;
+	// Scoped indexes follow the top-of-stack scope, which is replaced as
+	// scopes open and close; global and namespace domains only gain names
+	bool scoped;
+	symbol_trie trie;
+	std::size_t version = 0;
+	const cs::domain_type *walked = nullptr;
+	std::size_t walked_size = 0;
+	// First name of the walked scope, tells a scope that took over the old
+	// one's address and size apart without walking it
+	std::string walked_first;
+
+	void rebuild(const cs::domain_type &dom)
+	{
+		trie = symbol_trie();
+		for (auto &it : dom)
+			trie.insert(it.first);
+		++version;
+	}
+
+public:
+	symbol_index(std::function<const cs::domain_type &()> getter, bool is_scoped) : domain(std::move(getter)), scoped(is_scoped)
+	{
+		refresh();
+	}
+
+	std::size_t refresh()
+	{
+		const cs::domain_type &dom = domain();
+		if (scoped) {
+			std::string first = dom.begin() != dom.end() ? std::string(dom.begin()->first) : std::string();
+			if (&dom == walked && dom.size() == walked_size && first == walked_first)
+				return version;
+			// A new scope can reuse the old one's address, so compare the names
+			bool same = dom.size() == trie.size();
+			for (auto it = dom.begin(); same && it != dom.end(); ++it)
+				same = trie.contains(it->first);
+			if (!same)
+				rebuild(dom);
+			walked = &dom;
+			walked_size = dom.size();
+			walked_first.swap(first);
+			return version;
+		}
+		if (&dom != walked)
+			rebuild(dom);
+		else if (dom.size() != walked_size) {
+			bool changed = false;
+			for (auto &it : dom)
+				changed |= trie.insert(it.first);
+			if (changed)
+				++version;
+		}
+		walked = &dom;
+		walked_size = dom.size();
+		return version;
+	}
+
+	std::vector<std::string> prefix(const std::string &pre, std::size_t limit)
+	{
+		refresh();
+		return trie.prefix(pre, limit);
+	}
+
+	std::vector<std::string> fuzzy(const std::string &pattern, std::size_t limit)
+	{
+		refresh();
+		return trie.fuzzy(pattern, limit);
+	}
+
+	std::size_t size() const
+	{
+		return trie.size();
+	}
+};
+
+using symbol_index_t = std::shared_ptr<symbol_index>;
+
+// Walks the object graph reachable from a set of roots and tallies every
+// distinct object by type. Sizes are estimates of the native footprint:
+// the value holder plus what the container or string owns on the heap.
+class heap_census final {
+public:
+	struct type_stat {
+		const std::type_info *type = nullptr;
+		std::size_t count = 0, bytes = 0;
+	};
+
+private:
+	// Reference-counted holder behind every var, with its vtable and counters
+	static constexpr std::size_t holder_size = 4 * sizeof(void *);
+	static constexpr std::size_t deque_block = 512;
+
+	std::unordered_set<const void *> seen;
+	std::vector<cs::var> pending;
+	std::unordered_map<std::type_index, type_stat> stats;
+	std::size_t total = 0;
+
+	template <typename T>
+	const T *first_visit(const cs::var &val)
+	{
+		const T *obj = &val.const_val<T>();
+		return seen.insert(obj).second ? obj : nullptr;
+	}
+
+	std::size_t visit_domain(cs::domain_type &domain)
+	{
+		std::size_t bytes = 0;
+		for (auto &it : domain) {
+			bytes += sizeof(cs::var) + sizeof(std::string) + std::string(it.first).size();
+			pending.push_back(domain.get_var(it.first));
+		}
+		return bytes;
+	}
+
+	static std::size_t string_bytes(const std::string &str)
+	{
+		std::string empty;
+		return sizeof(std::string) + (str.capacity() > empty.capacity() ? str.capacity() + 1 : 0);
+	}
+
+	// Returns the shallow size, or zero when the object was already counted
+	std::size_t shallow(const cs::var &val)
+	{
+		if (val.type() == typeid(cs::string)) {
+			const auto *str = first_visit<cs::string>(val);
+			return str ? holder_size + string_bytes(*str) : 0;
+		}
+		if (val.type() == typeid(cs::array)) {
+			const auto *arr = first_visit<cs::array>(val);
+			if (!arr)
+				return 0;
+			pending.insert(pending.end(), arr->begin(), arr->end());
+			return holder_size + sizeof(cs::array) + (arr->size() * sizeof(cs::var) + deque_block - 1) / deque_block * deque_block;
+		}
+		if (val.type() == typeid(cs::list)) {
+			const auto *lst = first_visit<cs::list>(val);
+			if (!lst)
+				return 0;
+			pending.insert(pending.end(), lst->begin(), lst->end());
+			return holder_size + sizeof(cs::list) + lst->size() * (sizeof(cs::var) + 2 * sizeof(void *));
+		}
+		if (val.type() == typeid(cs::hash_map)) {
+			const auto *map = first_visit<cs::hash_map>(val);
+			if (!map)
+				return 0;
+			for (auto &it : *map) {
+				pending.push_back(it.first);
+				pending.push_back(it.second);
+			}
+			return holder_size + sizeof(cs::hash_map) + map->bucket_count() * sizeof(void *) + map->size() * (sizeof(cs::hash_map::value_type) + 2 * sizeof(void *));
+		}
+		if (val.type() == typeid(cs::hash_set)) {
+			const auto *set = first_visit<cs::hash_set>(val);
+			if (!set)
+				return 0;
+			pending.insert(pending.end(), set->begin(), set->end());
+			return holder_size + sizeof(cs::hash_set) + set->bucket_count() * sizeof(void *) + set->size() * (sizeof(cs::var) + 2 * sizeof(void *));
+		}
+		if (val.type() == typeid(cs::pair)) {
+			const auto *pr = first_visit<cs::pair>(val);
+			if (!pr)
+				return 0;
+			pending.push_back(pr->first);
+			pending.push_back(pr->second);
+			return holder_size + sizeof(cs::pair);
+		}
+		if (val.type() == typeid(cs::structure)) {
+			if (!first_visit<cs::structure>(val))
+				return 0;
+			return holder_size + sizeof(cs::structure) + visit_domain(val.val<cs::structure>().get_domain());
+		}
+		if (val.type() == typeid(cs::namespace_t)) {
+			if (!first_visit<cs::namespace_t>(val))
+				return 0;
+			return holder_size + sizeof(cs::namespace_t) + visit_domain(val.val<cs::namespace_t>()->get_domain());
+		}
+		// Scalars and opaque native objects only own their holder, they hold
+		// no script references so counting a shared one twice cannot loop
+		return holder_size;
+	}
+
+public:
+	void add_root(const cs::var &val)
+	{
+		pending.push_back(val);
+	}
+
+	void add_root(cs::domain_type &domain)
+	{
+		visit_domain(domain);
+	}
+
+	// Iterative so deeply nested or cyclic data cannot exhaust the stack
+	void run()
+	{
+		while (!pending.empty()) {
+			cs::var val = std::move(pending.back());
+			pending.pop_back();
+			std::size_t bytes = shallow(val);
+			if (bytes == 0)
+				continue;
+			type_stat &stat = stats[std::type_index(val.type())];
+			stat.type = &val.type();
+			++stat.count;
+			stat.bytes += bytes;
+			total += bytes;
+		}
+	}
+
+	std::size_t total_bytes() const
+	{
+		return total;
+	}
+
+	const std::unordered_map<std::type_index, type_stat> &get_stats() const
+	{
+		return stats;
+	}
+};
+
+#ifndef COVSCRIPT_PLATFORM_WIN32
+
+// Serves many REPL sessions over Unix sockets or pipe pairs from one epoll
+// loop on the calling thread. Input is read non-blocking and split into
+// lines, each round runs at most one line per session so a busy session
+// cannot starve the others, and whatever a line prints is captured and sent
+// back to its session. A session's REPL is only created once it sends code.
+class repl_server final {
+	static constexpr std::size_t max_line = 1 << 20;
+	static constexpr int max_events = 64;
+
+	struct session {
+		int in_fd, out_fd;
+		bool is_socket, reading = true, closing = false, closed = false, queued = false, out_registered = false;
+		std::string in_buff, out_buff;
+		std::deque<std::string> lines;
+		std::unique_ptr<repl_instance> repl;
+	};
+	using session_t = std::shared_ptr<session>;
+
+	cs::array args;
+	int epoll_fd = -1, listen_fd = -1;
+	std::string socket_path;
+	std::unordered_map<int, session_t> sessions;
+	std::deque<session_t> ready;
+	std::size_t session_count = 0;
+
+	struct cout_capture {
+		std::streambuf *old;
+		explicit cout_capture(std::ostream &target) : old(std::cout.rdbuf(target.rdbuf())) {}
+		~cout_capture()
+		{
+			std::cout.rdbuf(old);
+		}
+	};
+
+	// Writes with SIGPIPE blocked on this thread, so a pipe whose reader went
+	// away fails with EPIPE instead of killing the host. A SIGPIPE raised by
+	// the write is consumed before the old mask comes back.
+	static ssize_t write_pipe(int fd, const char *data, std::size_t size)
+	{
+		sigset_t pipe_set, old_set, pending;
+		sigemptyset(&pipe_set);
+		sigaddset(&pipe_set, SIGPIPE);
+		sigpending(&pending);
+		bool was_pending = sigismember(&pending, SIGPIPE) == 1;
+		::pthread_sigmask(SIG_BLOCK, &pipe_set, &old_set);
+		ssize_t n = ::write(fd, data, size);
+		int err = errno;
+		if (n < 0 && err == EPIPE && !was_pending) {
+			struct timespec zero {};
+			while (::sigtimedwait(&pipe_set, nullptr, &zero) < 0 && errno == EINTR);
+		}
+		::pthread_sigmask(SIG_SETMASK, &old_set, nullptr);
+		errno = err;
+		return n;
+	}
+
+	static void set_nonblocking(int fd)
+	{
+		int flags = ::fcntl(fd, F_GETFL, 0);
+		if (flags < 0 || ::fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+			throw cs::lang_error(std::string("REPL server: ") + std::strerror(errno));
+	}
+
+	void watch(int fd, std::uint32_t events, int op)
+	{
+		struct epoll_event ev {};
+		ev.events = events;
+		ev.data.fd = fd;
+		if (::epoll_ctl(epoll_fd, op, fd, &ev) < 0)
+			throw cs::lang_error(std::string("REPL server: ") + std::strerror(errno));
+	}
+
+	void add_session(int in_fd, int out_fd, bool is_socket)
+	{
+		session_t s = std::make_shared<session>();
+		s->in_fd = in_fd;
+		s->out_fd = out_fd;
+		s->is_socket = is_socket;
+		watch(in_fd, EPOLLIN | EPOLLRDHUP, EPOLL_CTL_ADD);
+		sessions[in_fd] = s;
+		if (out_fd != in_fd)
+			sessions[out_fd] = s;
+		++session_count;
+	}
+
+	// A closing session only drains its output, so its input stops waking epoll
+	void stop_reading(const session_t &s)
+	{
+		if (!s->reading)
+			return;
+		s->reading = false;
+		if (s->in_fd != s->out_fd)
+			::epoll_ctl(epoll_fd, EPOLL_CTL_DEL, s->in_fd, nullptr);
+		else
+			watch(s->in_fd, s->out_registered ? std::uint32_t(EPOLLOUT) : std::uint32_t(0), EPOLL_CTL_MOD);
+	}
+
+	void close_session(const session_t &s)
+	{
+		if (s->closed)
+			return;
+		s->closed = true;
+		if (s->reading || s->in_fd == s->out_fd)
+			::epoll_ctl(epoll_fd, EPOLL_CTL_DEL, s->in_fd, nullptr);
+		sessions.erase(s->in_fd);
+		::close(s->in_fd);
+		if (s->out_fd != s->in_fd) {
+			if (s->out_registered)
+				::epoll_ctl(epoll_fd, EPOLL_CTL_DEL, s->out_fd, nullptr);
+			sessions.erase(s->out_fd);
+			::close(s->out_fd);
+		}
+		s->repl.reset();
+		--session_count;
+	}
+
+	void accept_all()
+	{
+		while (true) {
+			int fd = ::accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+			if (fd < 0)
+				break;
+			add_session(fd, fd, true);
+		}
+	}
+
+	void read_input(const session_t &s)
+	{
+		if (!s->reading)
+			return;
+		char buff[4096];
+		// Only the unterminated tail is kept in in_buff, bound it while reading
+		std::size_t tail = s->in_buff.size();
+		bool too_long = false;
+		while (true) {
+			ssize_t n = ::read(s->in_fd, buff, sizeof(buff));
+			if (n > 0) {
+				s->in_buff.append(buff, n);
+				const char *newline = static_cast<const char *>(::memrchr(buff, '\n', n));
+				tail = newline == nullptr ? tail + n : buff + n - newline - 1;
+				if (tail > max_line) {
+					too_long = true;
+					break;
+				}
+				continue;
+			}
+			if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+				s->closing = true;
+			if (n == 0 || errno != EINTR)
+				break;
+		}
+		if (too_long) {
+			s->in_buff.clear();
+			s->lines.clear();
+			s->out_buff += "Error: line too long\n";
+			s->closing = true;
+			stop_reading(s);
+			return;
+		}
+		std::size_t start = 0, end;
+		while ((end = s->in_buff.find('\n', start)) != std::string::npos) {
+			std::size_t len = end - start;
+			if (len > 0 && s->in_buff[end - 1] == '\r')
+				--len;
+			s->lines.emplace_back(s->in_buff, start, len);
+			start = end + 1;
+		}
+		s->in_buff.erase(0, start);
+		if (s->closing)
+			stop_reading(s);
+		if (!s->lines.empty() && !s->queued) {
+			s->queued = true;
+			ready.push_back(s);
+		}
+	}
+
+	void flush_output(const session_t &s)
+	{
+		while (!s->out_buff.empty()) {
+			ssize_t n = s->is_socket ? ::send(s->out_fd, s->out_buff.data(), s->out_buff.size(), MSG_NOSIGNAL)
+			            : write_pipe(s->out_fd, s->out_buff.data(), s->out_buff.size());
+			if (n > 0) {
+				s->out_buff.erase(0, n);
+				continue;
+			}
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+				if (!s->out_registered) {
+					if (s->out_fd == s->in_fd)
+						watch(s->out_fd, (s->reading ? EPOLLIN | EPOLLRDHUP : 0) | EPOLLOUT, EPOLL_CTL_MOD);
+					else
+						watch(s->out_fd, EPOLLOUT, EPOLL_CTL_ADD);
+					s->out_registered = true;
+				}
+				return;
+			}
+			// Peer is gone, nothing more can be delivered
+			s->out_buff.clear();
+			s->lines.clear();
+			s->closing = true;
+		}
+		if (s->out_registered) {
+			if (s->out_fd == s->in_fd)
+				watch(s->out_fd, s->reading ? EPOLLIN | EPOLLRDHUP : 0, EPOLL_CTL_MOD);
+			else
+				::epoll_ctl(epoll_fd, EPOLL_CTL_DEL, s->out_fd, nullptr);
+			s->out_registered = false;
+		}
+	}
+
+	void execute(const session_t &s, const std::string &line)
+	{
+		if (!s->repl)
+			s->repl.reset(new repl_instance(args));
+		std::ostringstream output;
+		{
+			cout_capture capture(output);
+			try {
+				s->repl->exec(line);
+			}
+			catch (const std::exception &e) {
+				output << "Error: " << e.what() << std::endl;
+			}
+		}
+		s->out_buff += output.str();
+		if (s->repl->has_exited()) {
+			s->lines.clear();
+			s->closing = true;
+		}
+	}
+
+	// One line per queued session, sessions with more input go to the back
+	void run_round()
+	{
+		for (std::size_t n = ready.size(); n > 0; --n) {
+			session_t s = std::move(ready.front());
+			ready.pop_front();
+			s->queued = false;
+			if (s->closed || s->lines.empty())
+				continue;
+			std::string line = std::move(s->lines.front());
+			s->lines.pop_front();
+			execute(s, line);
+			flush_output(s);
+			if (!s->lines.empty() && !s->closed) {
+				s->queued = true;
+				ready.push_back(s);
+			}
 		}
 	}
 
-	~repl_instance() = default;
+public:
+	explicit repl_server(const cs::array &init_args) : args(init_args)
+	{
+		epoll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+		if (epoll_fd < 0)
+			throw cs::lang_error(std::string("REPL server: ") + std::strerror(errno));
+	}
 
-	bool has_exited() const
+	repl_server(const repl_server &) = delete;
+
+	~repl_server()
 	{
-		return exit_flag;
+		close();
+		::close(epoll_fd);
 	}
 
-	cs::var readline()
+	// Nobody accepts on a stale socket, so connecting is refused
+	static bool is_stale_socket(const struct sockaddr_un &addr)
 	{
-		try {
-			std::string line;
-#ifdef COVSCRIPT_PLATFORM_WIN32
-			// Workaround: https://stackoverflow.com/a/26763490
-			while (true) {
-				cs::current_process->poll_event();
-				std::getline(std::cin, line);
-				if (std::cin) break;
-			}
-#else
-			if (!std::cin) {
-				int code = 0;
-				cs::process_context::on_process_exit_default_handler(&code);
+		int probe = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if (probe < 0)
+			return false;
+		bool stale = ::connect(probe, reinterpret_cast<const struct sockaddr *>(&addr), sizeof(addr)) < 0 && errno == ECONNREFUSED;
+		::close(probe);
+		return stale;
+	}
+
+	void listen(const std::string &path)
+	{
+		if (listen_fd >= 0)
+			throw cs::lang_error("REPL server is already listening.");
+		struct sockaddr_un addr {};
+		if (path.size() >= sizeof(addr.sun_path))
+			throw cs::lang_error("REPL server socket path is too long.");
+		addr.sun_family = AF_UNIX;
+		std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+		int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if (fd < 0)
+			throw cs::lang_error(std::string("REPL server: ") + std::strerror(errno));
+		// Only a stale socket may be replaced, never a file that happens to be at
+		// path or a socket another server still listens on
+		struct stat st {};
+		if (::lstat(path.c_str(), &st) == 0) {
+			if (!S_ISSOCK(st.st_mode) || !is_stale_socket(addr)) {
+				::close(fd);
+				throw cs::lang_error(std::string("REPL server: ") + std::strerror(EADDRINUSE));
 			}
-			std::getline(std::cin, line);
-			cs::current_process->poll_event();
-#endif
-			return std::move(line);
-		}
-		catch (const std::exception &e) {
-			if (std::strstr(e.what(), "CS_SIGINT") != nullptr)
-				activate_sigint_handler();
-			else if (std::strstr(e.what(), "CS_EXIT") != nullptr)
-				exit_flag = true;
-			else
-				throw cs::lang_error(e.what());
+			::unlink(path.c_str());
 		}
-		catch (...) {
-			throw cs::lang_error("Uncaught exception: Unknown exception");
+		if (::bind(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) < 0 || ::listen(fd, SOMAXCONN) < 0) {
+			int err = errno;
+			::close(fd);
+			throw cs::lang_error(std::string("REPL server: ") + std::strerror(err));
 		}
-		return cs::null_pointer;
+		listen_fd = fd;
+		socket_path = path;
+		watch(listen_fd, EPOLLIN, EPOLL_CTL_ADD);
 	}
 
-	bool exec(const std::string &code)
+	// Takes ownership of both descriptors
+	void attach(int in_fd, int out_fd)
 	{
-		try {
-			repl_impl.exec(code);
-			return true;
+		if (sessions.count(in_fd) != 0 || sessions.count(out_fd) != 0)
+			throw cs::lang_error("Descriptor is already attached to the REPL server.");
+		set_nonblocking(in_fd);
+		set_nonblocking(out_fd);
+		add_session(in_fd, out_fd, false);
+	}
+
+	// Waits up to timeout_ms for input, then runs one scheduling round
+	std::size_t poll(int timeout_ms)
+	{
+		struct epoll_event events[max_events];
+		int count = ::epoll_wait(epoll_fd, events, max_events, ready.empty() ? timeout_ms : 0);
+		for (int i = 0; i < count; ++i) {
+			int fd = events[i].data.fd;
+			if (fd == listen_fd) {
+				accept_all();
+				continue;
+			}
+			auto it = sessions.find(fd);
+			if (it == sessions.end())
+				continue;
+			session_t s = it->second;
+			if (fd == s->in_fd && (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)))
+				read_input(s);
+			if (fd == s->out_fd && (events[i].events & (EPOLLERR | EPOLLHUP))) {
+				// Reader is gone, output can no longer be delivered
+				s->out_buff.clear();
+				s->lines.clear();
+				s->closing = true;
+				stop_reading(s);
+			}
+			else if (fd == s->out_fd && (events[i].events & EPOLLOUT))
+				flush_output(s);
 		}
-		catch (const std::exception &e) {
-			if (std::strstr(e.what(), "CS_SIGINT") != nullptr)
-				activate_sigint_handler();
-			else if (std::strstr(e.what(), "CS_EXIT") != nullptr)
-				exit_flag = true;
-			else
-				throw cs::lang_error(e.what());
+		run_round();
+		// Closing sessions linger until their captured output is delivered
+		std::vector<session_t> finished;
+		for (auto &it : sessions) {
+			const session_t &s = it.second;
+			if (s->closing && s->lines.empty()) {
+				flush_output(s);
+				if (s->out_buff.empty())
+					finished.push_back(s);
+			}
 		}
-		catch (...) {
-			throw cs::lang_error("Uncaught exception: Unknown exception");
+		for (auto &s : finished)
+			close_session(s);
+		return session_count;
+	}
+
+	std::size_t size() const
+	{
+		return session_count;
+	}
+
+	void close()
+	{
+		std::vector<session_t> all;
+		for (auto &it : sessions)
+			all.push_back(it.second);
+		for (auto &s : all)
+			close_session(s);
+		ready.clear();
+		if (listen_fd >= 0) {
+			::epoll_ctl(epoll_fd, EPOLL_CTL_DEL, listen_fd, nullptr);
+			::close(listen_fd);
+			::unlink(socket_path.c_str());
+			listen_fd = -1;
 		}
-		return false;
 	}
 };
 
-using repl_instance_t = std::shared_ptr<repl_instance>;
+using repl_server_t = std::shared_ptr<repl_server>;
+
+#endif
+
+// Calls a callable or object method per element from a C++ loop, reusing
+// one argument vector instead of building a fresh one for every call
+class element_invoker final {
+	const cs::callable *func = nullptr;
+	cs::var object;
+	bool is_method = false;
+	cs::vector args;
+
+public:
+	element_invoker(const cs::var &target, std::size_t arity)
+	{
+		if (target.type() == typeid(cs::callable))
+			func = &target.const_val<cs::callable>();
+		else if (target.type() == typeid(cs::object_method)) {
+			const auto &om = target.const_val<cs::object_method>();
+			func = &om.callable.const_val<cs::callable>();
+			object = om.object;
+			is_method = true;
+		}
+		else
+			throw cs::lang_error("Invoke non-callable object.");
+		args.resize(arity + (is_method ? 1 : 0));
+	}
+
+	// Slots are rewritten on every call, callees are free to move from them
+	template <typename... ArgsT>
+	cs::var operator()(const ArgsT &... vals)
+	{
+		std::size_t pos = 0;
+		if (is_method)
+			args[pos++] = object;
+		((args[pos++] = vals), ...);
+		return func->call(args);
+	}
+};
 
 CNI_ROOT_NAMESPACE {
 	using namespace cs;
@@ -194,6 +1479,81 @@ CNI_ROOT_NAMESPACE {
 		}
 
 		CNI(is_single)
+
+		numeric deep_size(const var &val) {
+			heap_census census;
+			census.add_root(val);
+			census.run();
+			return census.total_bytes();
+		}
+
+		CNI(deep_size)
+
+		var make_stat(numeric_integer count, numeric_integer bytes)
+		{
+			var ret = var::make<cs::hash_map>();
+			cs::hash_map &map = ret.val<cs::hash_map>();
+			map.emplace(var::make<cs::string>("count"), var::make<numeric>(count));
+			map.emplace(var::make<cs::string>("bytes"), var::make<numeric>(bytes));
+			return ret;
+		}
+
+		// Census of the objects reachable from the global and the current scope,
+		// keyed by the type_id typeids.get_real reports. This is not a count of
+		// every allocation in the process: the runtime does not expose the frames
+		// in between, so locals of enclosing calls only show up when reachable
+		// from these two, and unreachable garbage is never seen.
+		var reachable_stats(const cs::context_t &cxt) {
+			heap_census census;
+			cs::domain_type &global = cxt->instance->storage.get_global();
+			cs::domain_type &current = cxt->instance->storage.get_domain();
+			census.add_root(global);
+			if (&current != &global)
+				census.add_root(current);
+			census.run();
+			var ret = var::make<cs::hash_map>();
+			cs::hash_map &map = ret.val<cs::hash_map>();
+			for (auto &it : census.get_stats())
+				map.emplace(var::make<type_id>(*it.second.type), make_stat(it.second.count, it.second.bytes));
+			return ret;
+		}
+
+		CNI(reachable_stats)
+
+		numeric_integer stat_field(const cs::hash_map &stats, const var &type, const char *field)
+		{
+			auto it = stats.find(type);
+			if (it == stats.end())
+				return 0;
+			if (it->second.type() != typeid(cs::hash_map))
+				throw lang_error("Reachable statistics entry must be a hash map.");
+			const cs::hash_map &stat = it->second.const_val<cs::hash_map>();
+			auto value = stat.find(var::make<cs::string>(field));
+			if (value == stat.end() || value->second.type() != typeid(numeric))
+				throw lang_error("Reachable statistics entry lacks a numeric field.");
+			return value->second.const_val<numeric>().as_integer();
+		}
+
+		// Per-type change between two reachable_stats snapshots, unchanged types are omitted
+		var reachable_diff(const cs::hash_map &before, const cs::hash_map &after) {
+			var ret = var::make<cs::hash_map>();
+			cs::hash_map &map = ret.val<cs::hash_map>();
+			auto add_delta = [&](const var &type) {
+				if (map.count(type) != 0)
+					return;
+				numeric_integer count = stat_field(after, type, "count") - stat_field(before, type, "count");
+				numeric_integer bytes = stat_field(after, type, "bytes") - stat_field(before, type, "bytes");
+				if (count != 0 || bytes != 0)
+					map.emplace(type, make_stat(count, bytes));
+			};
+			for (auto &it : after)
+				add_delta(it.first);
+			for (auto &it : before)
+				add_delta(it.first);
+			return ret;
+		}
+
+		CNI(reachable_diff)
 	}
 
 	CNI_NAMESPACE(function)
@@ -236,6 +1596,61 @@ CNI_ROOT_NAMESPACE {
 		}
 
 		CNI(get_type)
+
+		// Callbacks may grow or shrink arr, so it is walked by index and each
+		// element is held by value while the callback runs. Results are copied
+		// like array.push_back does, so they never share a holder with arr.
+		var map(const var &func, const cs::array &arr) {
+			element_invoker invoke(func, 1);
+			var ret = var::make<cs::array>();
+			cs::array &out = ret.val<cs::array>();
+			for (std::size_t i = 0; i < arr.size(); ++i) {
+				var elem = arr[i];
+				out.emplace_back(cs::copy(invoke(elem)));
+			}
+			return ret;
+		}
+
+		CNI(map)
+
+		var filter(const var &func, const cs::array &arr) {
+			element_invoker invoke(func, 1);
+			var ret = var::make<cs::array>();
+			cs::array &out = ret.val<cs::array>();
+			for (std::size_t i = 0; i < arr.size(); ++i) {
+				var elem = arr[i];
+				var keep = invoke(elem);
+				if (keep.type() != typeid(cs::boolean))
+					throw lang_error("Filter predicate must return a boolean.");
+				if (keep.const_val<cs::boolean>())
+					out.emplace_back(cs::copy(elem));
+			}
+			return ret;
+		}
+
+		CNI(filter)
+
+		var reduce(const var &func, const cs::array &arr, const var &init) {
+			element_invoker invoke(func, 2);
+			var acc = init;
+			for (std::size_t i = 0; i < arr.size(); ++i) {
+				var elem = arr[i];
+				acc = invoke(acc, elem);
+			}
+			return acc;
+		}
+
+		CNI(reduce)
+
+		void for_each(const var &func, const cs::array &arr) {
+			element_invoker invoke(func, 1);
+			for (std::size_t i = 0; i < arr.size(); ++i) {
+				var elem = arr[i];
+				invoke(elem);
+			}
+		}
+
+		CNI(for_each)
 	}
 
 	var catch_stdexcept(const var &func, const cs::array &argument)
@@ -298,6 +1713,81 @@ CNI_ROOT_NAMESPACE {
 
 	CNI(predict_global_symbols)
 
+	CNI_NAMESPACE(symbols)
+	{
+		symbol_index_t index(const var &a) {
+			return std::make_shared<symbol_index>([a]() -> const domain_type & {
+				if (a.type() == typeid(namespace_t))
+					return a.val<namespace_t>()->get_domain();
+				else if (a.type() == typeid(type_t))
+					return a.const_val<type_t>().extensions->get_domain();
+				else if (a.type() == typeid(structure))
+					return a.val<structure>().get_domain();
+				else
+					return a.get_ext()->get_domain();
+			}, false);
+		}
+
+		CNI(index)
+
+		symbol_index_t current(const cs::context_t &cxt) {
+			return std::make_shared<symbol_index>([cxt]() -> const domain_type & {
+				return cxt->instance->storage.get_domain();
+			}, true);
+		}
+
+		CNI(current)
+
+		symbol_index_t global(const cs::context_t &cxt) {
+			return std::make_shared<symbol_index>([cxt]() -> const domain_type & {
+				return cxt->instance->storage.get_global();
+			}, false);
+		}
+
+		CNI(global)
+
+		numeric version(symbol_index_t & idx) {
+			return idx->refresh();
+		}
+
+		CNI(version)
+
+		numeric size(symbol_index_t & idx) {
+			idx->refresh();
+			return idx->size();
+		}
+
+		CNI(size)
+
+		var to_array(std::vector<std::string> &&names)
+		{
+			var ret = var::make<cs::array>();
+			cs::array &arr = ret.val<cs::array>();
+			for (auto &name : names)
+				arr.emplace_back(var::make<cs::string>(std::move(name)));
+			return ret;
+		}
+
+		std::size_t to_limit(const numeric &limit)
+		{
+			if (!limit.is_integer() || limit.as_integer() < 0)
+				throw lang_error("Symbol match limit must be a non-negative integer.");
+			return limit.as_integer();
+		}
+
+		var prefix(symbol_index_t & idx, const std::string &pre, const numeric &limit) {
+			return to_array(idx->prefix(pre, to_limit(limit)));
+		}
+
+		CNI(prefix)
+
+		var fuzzy(symbol_index_t & idx, const std::string &pattern, const numeric &limit) {
+			return to_array(idx->fuzzy(pattern, to_limit(limit)));
+		}
+
+		CNI(fuzzy)
+	}
+
 	void extend_type(cs::type_t &type, const std::string &name, const var &obj)
 	{
 		type.extensions->add_var(name.data(), obj);
@@ -326,6 +1816,12 @@ CNI_ROOT_NAMESPACE {
 
 		CNI(has_exited)
 
+		numeric exit_code(const repl_instance_t & repl) {
+			return repl->get_exit_code();
+		}
+
+		CNI(exit_code)
+
 		cs::var readline(repl_instance_t & repl) {
 			return repl->readline();
 		}
@@ -338,8 +1834,20 @@ CNI_ROOT_NAMESPACE {
 
 		CNI(exec)
 
+		repl_code_t compile(repl_instance_t & repl, const std::string &code) {
+			return repl->compile(code);
+		}
+
+		CNI(compile)
+
+		cs::var run(repl_instance_t & repl, const repl_code_t &code) {
+			return repl->run(code);
+		}
+
+		CNI(run)
+
 		void reset(repl_instance_t & repl) {
-			repl->repl_impl.reset_status();
+			repl->reset();
 		}
 
 		CNI(reset)
@@ -349,7 +1857,242 @@ CNI_ROOT_NAMESPACE {
 		}
 
 		CNI(echo)
+
+		repl_pool_t pool(const cs::numeric &size, const cs::array &args) {
+			if (!size.is_integer() || size.as_integer() < 0)
+				throw lang_error("REPL pool size must be a non-negative integer.");
+			repl_pool_t ret = std::make_shared<repl_pool>(args, size.as_integer());
+			ret->fill();
+			return ret;
+		}
+
+		CNI(pool)
+
+		// Cooperative, tasks run on the calling thread when the queue is driven
+		repl_queue_t queue(const cs::array &args) {
+			return std::make_shared<repl_queue>(args);
+		}
+
+		CNI(queue)
+
+#ifdef COVSCRIPT_PLATFORM_WIN32
+		var server(const cs::array &args) {
+			(void)args;
+			throw lang_error("REPL server is not supported on this platform.");
+		}
+#else
+		repl_server_t server(const cs::array &args) {
+			return std::make_shared<repl_server>(args);
+		}
+#endif
+
+		CNI(server)
+	}
+
+	CNI_NAMESPACE(repl_queue)
+	{
+		repl_future_t exec_async(repl_queue_t & queue, const std::string &code) {
+			return queue->post([code](repl_instance & repl) {
+				repl_message msg;
+				msg.type = repl_message::kind::boolean;
+				msg.boolean = repl.exec(code);
+				return msg;
+			});
+		}
+
+		CNI(exec_async)
+
+		repl_future_t eval_async(repl_queue_t & queue, const std::string &code) {
+			return queue->post([code](repl_instance & repl) {
+				return repl_message::from_var(repl.run(repl.compile(code)));
+			});
+		}
+
+		CNI(eval_async)
+
+		bool run_one(repl_queue_t & queue) {
+			return queue->run_one();
+		}
+
+		CNI(run_one)
+
+		numeric run_all(repl_queue_t & queue) {
+			return queue->run_all();
+		}
+
+		CNI(run_all)
+
+		void cancel(repl_queue_t & queue) {
+			queue->cancel();
+		}
+
+		CNI(cancel)
+
+		numeric pending(const repl_queue_t & queue) {
+			return queue->pending();
+		}
+
+		CNI(pending)
+
+		bool has_exited(const repl_queue_t & queue) {
+			return queue->has_exited();
+		}
+
+		CNI(has_exited)
+	}
+
+#ifndef COVSCRIPT_PLATFORM_WIN32
+	CNI_NAMESPACE(repl_server)
+	{
+		void listen(repl_server_t & server, const std::string &path) {
+			server->listen(path);
+		}
+
+		CNI(listen)
+
+		void attach(repl_server_t & server, const numeric &in_fd, const numeric &out_fd) {
+			if (!in_fd.is_integer() || !out_fd.is_integer() || in_fd.as_integer() < 0 || out_fd.as_integer() < 0)
+				throw lang_error("REPL server descriptors must be non-negative integers.");
+			server->attach(in_fd.as_integer(), out_fd.as_integer());
+		}
+
+		CNI(attach)
+
+		numeric poll(repl_server_t & server, const numeric &timeout_ms) {
+			if (!timeout_ms.is_integer())
+				throw lang_error("REPL server timeout must be an integer.");
+			return server->poll(timeout_ms.as_integer());
+		}
+
+		CNI(poll)
+
+		numeric size(const repl_server_t & server) {
+			return server->size();
+		}
+
+		CNI(size)
+
+		void close(repl_server_t & server) {
+			server->close();
+		}
+
+		CNI(close)
+	}
+#endif
+
+	CNI_NAMESPACE(repl_future)
+	{
+		bool ready(const repl_future_t & future) {
+			return future->ready();
+		}
+
+		CNI(ready)
+
+		void wait(const repl_future_t & future) {
+			future->wait();
+		}
+
+		CNI(wait)
+
+		var get(const repl_future_t & future) {
+			return future->get();
+		}
+
+		CNI(get)
+	}
+
+	CNI_NAMESPACE(channel)
+	{
+		repl_channel_t create(const cs::numeric &capacity) {
+			if (!capacity.is_integer() || capacity.as_integer() <= 0)
+				throw lang_error("Channel capacity must be a positive integer.");
+			return std::make_shared<repl_channel>(capacity.as_integer());
+		}
+
+		CNI(create)
+
+		void send(repl_channel_t & ch, const var &val) {
+			repl_message msg = repl_message::from_var(val);
+			ch->push(msg);
+		}
+
+		CNI(send)
+
+		bool try_send(repl_channel_t & ch, const var &val) {
+			repl_message msg = repl_message::from_var(val);
+			return ch->try_push(msg);
+		}
+
+		CNI(try_send)
+
+		var recv(repl_channel_t & ch) {
+			return ch->pop().to_var();
+		}
+
+		CNI(recv)
+
+		var try_recv(repl_channel_t & ch) {
+			repl_message msg;
+			if (ch->try_pop(msg))
+				return msg.to_var();
+			return null_pointer;
+		}
+
+		CNI(try_recv)
+
+		numeric size(const repl_channel_t & ch) {
+			return ch->size();
+		}
+
+		CNI(size)
+
+		numeric capacity(const repl_channel_t & ch) {
+			return ch->capacity();
+		}
+
+		CNI(capacity)
+	}
+
+	CNI_NAMESPACE(repl_pool)
+	{
+		void snapshot(repl_pool_t & pool, const cs::array &codes) {
+			pool->set_snapshot(codes);
+		}
+
+		CNI(snapshot)
+
+		void fill(repl_pool_t & pool) {
+			pool->fill();
+		}
+
+		CNI(fill)
+
+		repl_instance_t acquire(repl_pool_t & pool) {
+			return pool->acquire();
+		}
+
+		CNI(acquire)
+
+		numeric size(const repl_pool_t & pool) {
+			return pool->size();
+		}
+
+		CNI(size)
+
+		numeric capacity(const repl_pool_t & pool) {
+			return pool->get_capacity();
+		}
+
+		CNI(capacity)
 	}
 }
 
 CNI_ENABLE_TYPE_EXT(repl, repl_instance_t)
+CNI_ENABLE_TYPE_EXT(repl_pool, repl_pool_t)
+CNI_ENABLE_TYPE_EXT(repl_queue, repl_queue_t)
+CNI_ENABLE_TYPE_EXT(repl_future, repl_future_t)
+CNI_ENABLE_TYPE_EXT(channel, repl_channel_t)
+CNI_ENABLE_TYPE_EXT(symbols, symbol_index_t)
+#ifndef COVSCRIPT_PLATFORM_WIN32
+CNI_ENABLE_TYPE_EXT(repl_server, repl_server_t)
+#endif
@@ -8,4 +8,82 @@ system.out.println(
         .logic_and("0xA"hex)
         .any()
 )
-@end
\ No newline at end of file
+@end
+var mask = bitvec.create(1000)
+var bits = bitvec.create(1000)
+foreach i in range(0, 1000, 3) do mask.set(i)
+foreach i in range(0, 1000, 5) do bits.set(i)
+bits.and_assign(mask)
+system.out.println("bitvec count: " + to_string(bits.count()))
+system.out.println("bitvec rank(500): " + to_string(bits.rank(500)))
+var pos = bits.find_next(bits.find_first())
+system.out.println("bitvec second bit: " + to_string(pos))
+system.out.println(bitvec.from_string("1011").shift_left(1).to_string())
+system.out.println("crc32: " + to_string(crc32("123456789")))
+system.out.println("crc32c: " + to_string(crc32c("123456789")))
+system.out.println("crc32 streamed: " + to_string(crc32_update(crc32("12345"), "6789")))
+var flags = "0x1"hex
+flags.shl_assign(3)
+flags.and_assign("0xA"hex)
+system.out.println(flags.any())
+var decode = compile("(a << 3) & b | ~mask & 0xFF")
+system.out.println(decode.inputs())
+system.out.println(decode.eval({"0x1"hex, "0xA"hex, 240}).to_string())
+system.out.println(decode.eval_map({"a" : 1, "b" : 10, "mask" : 240}).to_number())
+var ids = new roaring
+ids.add_range(100000, 200000)
+ids.add_many({7, 42, 1000000})
+var other = roaring.from_array({42, 150000, 3000000})
+system.out.println("roaring cardinality: " + to_string(ids.cardinality()))
+system.out.println(ids.logic_and(other).to_array())
+ids.optimize()
+system.out.println(roaring.deserialize(ids.serialize()).equals(ids))
+var column = {1000, 1003, 1007, 1010, 1012}
+system.out.println(codec.varint_decode(codec.varint_encode(column)))
+system.out.println(codec.svarint_decode(codec.svarint_encode({-3, 0, 64, -65})))
+system.out.println(codec.bitpack_decode(codec.bitpack_encode({1, 2, 3, 4}, 3), 3, 4))
+system.out.println("delta bytes: " + to_string(codec.delta_encode(column).size))
+system.out.println(codec.delta_decode(codec.delta_encode(column)))
+system.out.println(hash.xxh3_64("hello").to_string())
+system.out.println(hash.xxh3_128_seed("hello", 42))
+# wyhash final 4 reference vectors: empty, <= 16, 17-48 and > 48 bytes
+@begin
+var wy_vectors = {
+    {"", 0, "0x93228a4de0eec5a2", "0x93228a4de0eec5a2"},
+    {"", 42, "0x2ac44db3deb05300", "0x93228a4de0eec5a2"},
+    {"a", 1, "0xc5bac3db178713c4", "0xaced12527fe5bff8"},
+    {"abc", 2, "0xa97f2f7b1d9b3314", "0x989b4a209c1011c9"},
+    {"message digest", 3, "0x786d1f1df3801df4", "0x309ab4c045215e8f"},
+    {"abcdefghijklmnopqrstuvwxyz", 4, "0xdca5a8138ad37c87", "0xccaeadc12a061176"},
+    {"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789", 5, "0xb9e734f117cfaf70", "0x1fdd130ecb5b4709"},
+    {"12345678901234567890123456789012345678901234567890123456789012345678901234567890", 6, "0x6cc5eab49a92d617", "0x7e22da19f1a6055a"}
+}
+@end
+foreach v in wy_vectors
+    if hash.wyhash_seed(v[0], v[1]).to_string() != hex_literal(v[2]).to_string()
+        throw runtime_error("wyhash_seed mismatch for \"" + v[0] + "\"")
+    end
+    if hash.wyhash(v[0]).to_string() != hex_literal(v[3]).to_string()
+        throw runtime_error("wyhash mismatch for \"" + v[0] + "\"")
+    end
+end
+system.out.println("wyhash vectors: " + to_string(wy_vectors.size))
+system.out.println(hash.fnv1a("a").to_hash())
+var h = hasher.xxh3(0)
+h.update("hel")
+h.update("lo")
+system.out.println(h.digest().to_string() == hash.xxh3_64("hello").to_string())
+var seen = bloom.create(10000, 0.01)
+seen.add_many({"alice", "bob", 42})
+system.out.println(seen.contains_many({"alice", "carol", 42}))
+system.out.println(bloom.deserialize(seen.serialize()).contains("bob"))
+var freq = count_min.create(0.001, 0.01)
+freq.add_many({"a", "b", "a", "c", "a"})
+freq.add("b", 10)
+system.out.println(freq.estimate_many({"a", "b", "z"}))
+var visitors = hyperloglog.create(14)
+foreach i in range(10000) do visitors.add(i % 2500)
+var more = hyperloglog.create(14)
+more.add_many({"x", "y", "z"})
+visitors.merge(more)
+system.out.println("distinct visitors: " + to_string(visitors.estimate()))
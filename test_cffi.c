@@ -27,3 +27,53 @@ void print(const char* str)
 {
 	printf("\"print\" called, str = \"%s\"\n", str);
 }
+
+int add_quiet(int a, int b)
+{
+	return a + b;
+}
+
+double scale_quiet(double val, float factor)
+{
+	return val * factor;
+}
+
+void fill_sequence(unsigned int *data, size_t count)
+{
+	for (size_t i = 0; i < count; ++i)
+		data[i] = (unsigned int)(i * i);
+}
+
+struct point {
+	int x;
+	double y;
+};
+
+struct point scale_point(struct point pt, int factor)
+{
+	pt.x *= factor;
+	pt.y *= factor;
+	return pt;
+}
+
+double sum_points(const struct point *pts, size_t count)
+{
+	double sum = 0;
+	for (size_t i = 0; i < count; ++i)
+		sum += pts[i].x + pts[i].y;
+	return sum;
+}
+
+int apply_twice(int (*func)(int), int value)
+{
+	return func(func(value));
+}
+
+size_t count_char(const char *data, size_t size, int ch)
+{
+	size_t count = 0;
+	for (size_t i = 0; i < size; ++i)
+		if (data[i] == ch)
+			++count;
+	return count;
+}
@@ -5,6 +5,9 @@ var add = lib.import_func_s("add", cffi.types.sint, {cffi.types.sint, cffi.types
 foreach i in range(10)
     system.out.println("value from host: " + add(i, i*2))
 end
+# Test batched calls
+system.out.println(cffi.lib.call_batch(add, {{1, 2}, {3, 4}, {5, 6}}))
+system.out.println(cffi.lib.call_batch_columns(add, {{1, 3, 5}, {2, 4, 6}}))
 # Test strings
 var connect_str = lib.import_func_s("connect_str", cffi.types.pointer, {cffi.types.string, cffi.types.string})
 var free_str = lib.import_func("free_str")
@@ -12,6 +15,56 @@ var ptr = connect_str("Hello, ", "world!")
 system.out.println(cffi.utils.make_integer(ptr))
 system.out.println(cffi.utils.make_string(ptr))
 free_str(ptr)
+# Test CIF cache of untyped functions
+foreach i in range(3)
+    free_str(connect_str("cached ", "call"))
+end
+var stats = cffi.utils.cif_cache_stats()
+system.out.println("cif cache hits: " + stats["hits"] + ", misses: " + stats["misses"])
+# Test borrowed and sized strings
+var print_ref = lib.import_func_s("print", cffi.types.void, {cffi.types.string_ref})
+print_ref("borrowed string")
+var count_char = lib.import_func_s("count_char", cffi.types.ulong, {cffi.types.bytes, cffi.types.sint})
+system.out.println("count_char: " + count_char("{\"a\": [1, 2, 3]}", to_integer(',')))
+# Test buffers
+var fill_sequence = lib.import_func_s("fill_sequence", cffi.types.void, {cffi.types.pointer, cffi.types.ulong})
+var buff = cffi.buffer.create(64)
+fill_sequence(buff, 16)
+system.out.println("buffer[15] = " + buff.get_u32(15))
+var view = buff.slice(32, 32)
+fill_sequence(view, 8)
+system.out.println("buffer[15] = " + buff.get_u32(15))
+system.out.println(cffi.buffer.from_string("Hello, buffer!").to_string())
+# Test structs
+var point = cffi.types.make_struct({"x", "y"}, {cffi.types.sint, cffi.types.double})
+var scale_point = lib.import_func_s("scale_point", point, {point, cffi.types.sint})
+var pt = scale_point(point.pack({"x": 2, "y": 0.5}), 3)
+system.out.println("scaled point: " + point.get(pt, 0, "x") + ", " + point.get(pt, 0, "y"))
+var sum_points = lib.import_func_s("sum_points", cffi.types.double, {cffi.types.pointer, cffi.types.ulong})
+var pts = point.make_array(4)
+point.set_column(pts, "x", {1, 2, 3, 4})
+point.set_column(pts, "y", {0.5, 0.5, 0.5, 0.5})
+system.out.println("sum of points: " + sum_points(pts, point.count(pts)))
+# Test callbacks
+var apply_twice = lib.import_func_s("apply_twice", cffi.types.sint, {cffi.types.pointer, cffi.types.sint})
+var triple = cffi.make_callback([](x) -> x * 3, cffi.types.sint, {cffi.types.sint})
+system.out.println("apply_twice: " + apply_twice(triple, 2))
+# Test import tables
+var native = lib.import_table({
+    {"add_quiet", cffi.types.sint, {cffi.types.sint, cffi.types.sint}},
+    {"scale_quiet", cffi.types.double, {cffi.types.double, cffi.types.float}},
+    "free_str"
+})
+system.out.println("import_table: " + native.add_quiet(1, 2) + ", " + native.scale_quiet(1.5, 2))
+var native_lazy = lib.import_table_lazy({{"add_quiet", cffi.types.sint, {cffi.types.sint, cffi.types.sint}}})
+system.out.println("import_table_lazy: " + native_lazy.add_quiet(3, 4))
+# Test asynchronous calls
+var add_async = lib.import_func_async("add_quiet", cffi.types.sint, {cffi.types.sint, cffi.types.sint})
+var futures = new array
+foreach i in range(4) do futures.push_back(add_async(i, 10))
+foreach fut in futures
+    system.out.println("add_async: " + fut.get())
+end
 # Test print
 var print = lib.import_func("print")
 loop
@@ -7,4 +7,81 @@ foreach i in range(10)
     repl = null
 end
 
+var pool = sdk.repl.pool(4, {})
+pool.snapshot({"var base = 10"})
+
+foreach i in range(10)
+    var repl = pool.acquire()
+    repl.exec("var a = base + " + i)
+    repl.exec("a")
+    # Used instances are discarded, not recycled
+    repl = null
+    # Idle time between requests: warm up replacements for the ones handed out
+    pool.fill()
+end
+
+var rules = sdk.repl.create({})
+rules.exec("var x = 0")
+var rule = rules.compile("x * x + 1")
+var total = 0
+foreach i in range(100)
+    rules.exec("x = " + i)
+    total += rules.run(rule)
+end
+system.out.println("Rule total: " + to_string(total))
+
+var results = sdk.channel.create(16)
+var queues = {}
+var tasks = {}
+foreach i in range(4)
+    var queue = sdk.repl.queue({})
+    queue.exec_async("var n = " + i)
+    tasks.push_back(queue.eval_async("n * n"))
+    queues.push_back(queue)
+end
+# Nothing has run yet: tasks only run when the queue is driven
+system.out.println(queues[0].pending() == 2 && !tasks[0].ready())
+queues[1].run_all()
+system.out.println(tasks[1].ready())
+foreach task in tasks do results.send(task.get())
+var squares = 0
+while results.size() > 0
+    squares += results.recv()
+end
+system.out.println("Worker squares: " + to_string(squares))
+
+var symbols = sdk.symbols.global(context)
+var stamp = symbols.version()
+system.out.println(symbols.prefix("wor", 5))
+var worker_count = queues.size
+system.out.println(symbols.version() != stamp)
+var wc = 0
+var word_count = 0
+var WorkCount = 0
+var ranked = symbols.fuzzy("wc", 3)
+system.out.println(ranked)
+if ranked.size != 3 || ranked[0] != "wc"
+    throw runtime_error("fuzzy: exact match must rank first")
+end
+
+var numbers = {1, 2, 3, 4, 5, 6}
+var evens = sdk.function.filter([](n) -> n % 2 == 0, numbers)
+system.out.println(sdk.function.map([](n) -> n * n, evens))
+system.out.println(sdk.function.reduce([](acc, n) -> acc + n, numbers, 0))
+sdk.function.for_each(system.out.println, evens)
+
+var before = sdk.variable.reachable_stats(context)
+var cache = {}
+foreach i in range(1000) do cache.push_back("item-" + to_string(i))
+system.out.println("Cache bytes: " + to_string(sdk.variable.deep_size(cache)))
+var rows = {}
+foreach i in range(10) do rows.push_back({i})
+var grown = sdk.variable.reachable_diff(before, sdk.variable.reachable_stats(context))
+# cache, rows and the ten rows inside it
+var array_count = grown[sdk.typeids.get_real(cache)]["count"]
+system.out.println("Reachable arrays added: " + to_string(array_count))
+if array_count != 12
+    throw runtime_error("reachable_diff: expected 12 new arrays")
+end
+
 system.out.println("Good")
@@ -0,0 +1,62 @@
+import sdk_extension as sdk
+import cffi
+
+var server = sdk.repl.server({})
+server.listen("./test_repl_server.sock")
+# A second server must not take over a socket that is still served
+var rival = sdk.repl.server({})
+var refused = false
+try
+    rival.listen("./test_repl_server.sock")
+catch e
+    refused = true
+end
+if !refused
+    throw runtime_error("listen: took over a live socket")
+end
+foreach i in range(10) do server.poll(10)
+system.out.println("REPL server sessions: " + to_string(server.size()))
+
+# Round trip one line through a socket session and a pipe session
+var libc = cffi.import_lib("libc.so.6")
+var c_socket = libc.import_func_s("socket", cffi.types.sint, {cffi.types.sint, cffi.types.sint, cffi.types.sint})
+var c_connect = libc.import_func_s("connect", cffi.types.sint, {cffi.types.sint, cffi.types.pointer, cffi.types.uint})
+var c_pipe = libc.import_func_s("pipe", cffi.types.sint, {cffi.types.pointer})
+var c_write = libc.import_func_s("write", cffi.types.slong, {cffi.types.sint, cffi.types.bytes})
+var c_read = libc.import_func_s("read", cffi.types.slong, {cffi.types.sint, cffi.types.pointer, cffi.types.ulong})
+var c_close = libc.import_func_s("close", cffi.types.sint, {cffi.types.sint})
+function read_output(fd)
+    var buff = cffi.buffer.create(256)
+    var n = c_read(fd, buff, buff.size())
+    if n <= 0
+        return ""
+    end
+    return buff.slice(0, n).to_string()
+end
+# struct sockaddr_un: AF_UNIX, then the path
+var addr = cffi.buffer.create(110)
+var path = cffi.buffer.from_string("./test_repl_server.sock")
+addr.set_u16(0, 1)
+addr.copy(2, path, 0, path.size())
+var client = c_socket(1, 1, 0)
+c_connect(client, addr, addr.size())
+# Two pipes: the server reads fds[0] and writes fds[3]
+var fds = cffi.buffer.create(16)
+c_pipe(fds.slice(0, 8))
+c_pipe(fds.slice(8, 8))
+server.attach(fds.get_i32(0), fds.get_i32(3))
+c_write(client, "1 + 2\n")
+c_write(fds.get_i32(1), "3 + 4\n")
+foreach i in range(10) do server.poll(10)
+system.out.print("socket session: " + read_output(client))
+system.out.print("pipe session: " + read_output(fds.get_i32(2)))
+# A pipe whose reader is gone closes its session instead of raising SIGPIPE
+c_close(fds.get_i32(2))
+c_write(fds.get_i32(1), "5 + 6\n")
+foreach i in range(10) do server.poll(10)
+system.out.println("REPL server sessions: " + to_string(server.size()))
+c_close(fds.get_i32(1))
+c_close(client)
+server.close()
+
+system.out.println("Good")